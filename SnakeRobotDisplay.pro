@@ -2,25 +2,23 @@
 #
 # Project created by QtCreator 2015-02-05T17:07:32
 #
+# core is the GUI-free data engine, everything else links it
+#
 #-------------------------------------------------
 
-QT       += core gui
-QT       += opengl
-
-greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
-
-CONFIG += c++11
-
-TARGET = display2Dmodel
-TEMPLATE = app
-
+TEMPLATE = subdirs
 
-SOURCES += main.cpp\
-        mainwindow.cpp
+SUBDIRS += core \
+    display \
+    benchmarks \
+    datfgen \
+    datfexport
 
-HEADERS  += mainwindow.h \
-    matlabinterface.h \
-    dimensions.h \
-    graphicsitems.h
+display.file = display.pro
+datfgen.subdir = tools/datfgen
+datfexport.subdir = tools/datfexport
 
-FORMS    += mainwindow.ui
+display.depends = core
+benchmarks.depends = core
+datfgen.depends = core
+datfexport.depends = core
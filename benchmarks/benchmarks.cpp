@@ -0,0 +1,407 @@
+#include <QtTest/QtTest>
+#include <QApplication>
+#include <QGraphicsScene>
+#include <QTemporaryDir>
+#include <QXmlStreamReader>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <cmath>
+#include <vector>
+#include "matlabinterface.h"
+#include "kinematics.h"
+#include "graphicsitems.h"
+#include "frameexporter.h"
+#include "simdkernels.h"
+#include "runcache.h"
+
+// Bytes processed per iteration of a benchmark row, keyed by "function/tag", for throughput in the JSON
+static QMap<QString,qint64> bytesPerIteration;
+// Error bounds of the storage of a benchmark row, in field order of snakeSectionData, keyed the same way
+static QMap<QString,QJsonArray> maxErrors;
+
+// A valid .datf with a travelling sine wave along the body, sample rate 100 Hz
+static void writeDatf(const QString & fileName, quint32 sections, quint32 samples)
+{
+    QFile f(fileName);
+    f.open(QIODevice::WriteOnly);
+    QDataStream out(&f);
+    out.setByteOrder(QDataStream::LittleEndian);
+    out.setFloatingPointPrecision(QDataStream::SinglePrecision);
+    out << sections << samples;
+    const float length = 0.1f;
+    for(quint32 i = 0; i < samples; ++i)
+    {
+        const float t = 0.01f*i;
+        out << t << 0.05f*t << 0.0f << 0.0f;
+        for(quint32 j = 0; j < sections; ++j)
+        {
+            const float phase = 2.0f*t - 0.5f*j;
+            const float phi = 0.4f*std::sin(phase);
+            out << (0.05f*t - length*j) << 0.02f*std::sin(phase) << phi
+                << 0.05f << 0.04f*std::cos(phase) << 0.8f*std::cos(phase)
+                << 0.3f*std::cos(phase) << 0.3f*std::sin(phase) << 0.1f*std::sin(phase+0.5f);
+        }
+    }
+}
+
+class datfBenchmarks : public QObject
+{
+    Q_OBJECT
+
+private:
+    QTemporaryDir dir;
+
+    QString getFile(quint32 sections, quint32 samples)
+    {
+        QString fileName = dir.filePath(QString("bench_%1_%2.datf").arg(sections).arg(samples));
+        if(!QFile::exists(fileName))
+        {
+            writeDatf(fileName,sections,samples);
+        }
+        return fileName;
+    }
+
+    static qint64 getFileSize(quint32 sections, quint32 samples)
+    {
+        return 8 + qint64(samples)*(4 + sections*9)*4;
+    }
+
+    void addSizeRows()
+    {
+        QTest::addColumn<int>("sections");
+        QTest::addColumn<int>("samples");
+        QTest::newRow("10 sections, 1000 samples") << 10 << 1000;
+        QTest::newRow("10 sections, 100000 samples") << 10 << 100000;
+        QTest::newRow("100 sections, 10000 samples") << 100 << 10000;
+        QTest::newRow("1000 sections, 1000 samples") << 1000 << 1000;
+    }
+
+    void recordBytes(qint64 bytes)
+    {
+        bytesPerIteration[QString(QTest::currentTestFunction()) + "/" + QTest::currentDataTag()] = bytes;
+    }
+
+    void recordMaxErrors(const sampleStore & store)
+    {
+        QJsonArray errors;
+        for(int i = 0; i < sampleStore::FLOATS_PER_SECTION; ++i)
+        {
+            errors.append(double(store.getMaxError(i)));
+        }
+        maxErrors[QString(QTest::currentTestFunction()) + "/" + QTest::currentDataTag()] = errors;
+    }
+
+private slots:
+    void parse_data()
+    {
+        addSizeRows();
+    }
+
+    void parse()
+    {
+        QFETCH(int,sections);
+        QFETCH(int,samples);
+        QString fileName = getFile(sections,samples);
+        recordBytes(getFileSize(sections,samples));
+        QBENCHMARK
+        {
+            matlabFileInterface f(fileName);
+            QCOMPARE(f.getNumberOfSamples(),samples);
+        }
+    }
+
+    // Reopening a file with a valid run cache, the cache is mapped instead of parsed
+    void cachedOpen_data()
+    {
+        QTest::addColumn<int>("sections");
+        QTest::addColumn<int>("samples");
+        QTest::newRow("10 sections, 100000 samples") << 10 << 100000;
+        QTest::newRow("100 sections, 10000 samples") << 100 << 10000;
+        QTest::newRow("1000 sections, 1000 samples") << 1000 << 1000;
+    }
+
+    void cachedOpen()
+    {
+        QFETCH(int,sections);
+        QFETCH(int,samples);
+        QString fileName = getFile(sections,samples);
+        recordBytes(getFileSize(sections,samples));
+        setRunCacheDirectory(dir.filePath("cache"));
+        {
+            matlabFileInterface f(fileName);
+            f.saveCache();
+        }
+        QBENCHMARK
+        {
+            matlabFileInterface f(fileName);
+            QCOMPARE(f.getNumberOfSamples(),samples);
+        }
+        setRunCacheDirectory(QString());
+    }
+
+    // Random jumps, each one a binary search
+    void seek_data()
+    {
+        addSizeRows();
+    }
+
+    void seek()
+    {
+        QFETCH(int,sections);
+        QFETCH(int,samples);
+        matlabFileInterface f(getFile(sections,samples));
+        std::vector<float> times(1024);
+        for(unsigned int i = 0; i < times.size(); ++i)
+        {
+            times[i] = f.get_lastTime()*float((i*7919) % times.size())/float(times.size());
+        }
+        quint32 cursor = 0;
+        int sum = 0;
+        QBENCHMARK
+        {
+            for(unsigned int i = 0; i < times.size(); ++i)
+            {
+                sum += f.locate(times[i],cursor).i1;
+            }
+        }
+        QVERIFY(sum >= 0);
+    }
+
+    // One frame of playback, the cursor moves forward a fraction of a sample
+    void interpolation_data()
+    {
+        addSizeRows();
+    }
+
+    void interpolation()
+    {
+        QFETCH(int,sections);
+        QFETCH(int,samples);
+        matlabFileInterface f(getFile(sections,samples));
+        recordBytes(2*qint64(sections)*sizeof(snakeSectionData));
+        snakeFrame frame;
+        quint32 cursor = 0;
+        float t = 0.0f;
+        QBENCHMARK
+        {
+            t += 0.0037f;
+            if(t > f.get_lastTime())
+            {
+                t = 0.0f;
+            }
+            f.sampleFrame(t,cursor,frame);
+        }
+    }
+
+    // Playback from compact storage, the rows are decoded before they are interpolated
+    void storageInterpolation_data()
+    {
+        QTest::addColumn<int>("storage");
+        for(int s = 0; s < NUMBER_OF_STORAGES; ++s)
+        {
+            QTest::newRow(getStorageName(sampleStorage(s))) << s;
+        }
+    }
+
+    void storageInterpolation()
+    {
+        QFETCH(int,storage);
+        matlabFileInterface f(getFile(100,10000),sampleStorage(storage));
+        recordBytes(2*f.getSampleStore().getBytes()/f.getNumberOfSamples());
+        recordMaxErrors(f.getSampleStore());
+        snakeFrame frame;
+        quint32 cursor = 0;
+        float t = 0.0f;
+        QBENCHMARK
+        {
+            t += 0.0037f;
+            if(t > f.get_lastTime())
+            {
+                t = 0.0f;
+            }
+            f.sampleFrame(t,cursor,frame);
+        }
+    }
+
+    void kinematics_data()
+    {
+        QTest::addColumn<int>("sections");
+        QTest::newRow("10 sections") << 10;
+        QTest::newRow("100 sections") << 100;
+        QTest::newRow("1000 sections") << 1000;
+    }
+
+    void kinematics()
+    {
+        QFETCH(int,sections);
+        matlabFileInterface f(getFile(sections,1000));
+        snakeFrame frame;
+        quint32 cursor = 0;
+        f.sampleFrame(1.234f,cursor,frame);
+        std::vector<segmentPose> poses;
+        QBENCHMARK
+        {
+            computeFramePoses(frame,poses);
+        }
+    }
+
+    // Pushing one frame to the items of a scene, what updateSegments does every frame
+    void sceneUpdate_data()
+    {
+        kinematics_data();
+    }
+
+    void sceneUpdate()
+    {
+        QFETCH(int,sections);
+        matlabFileInterface f(getFile(sections,1000));
+        std::vector<snakeFrame> frames(64);
+        quint32 cursor = 0;
+        for(unsigned int i = 0; i < frames.size(); ++i)
+        {
+            f.sampleFrame(0.05f*i,cursor,frames[i]);
+        }
+        QGraphicsScene scene;
+        exportOptions options;
+        snakeRenderer renderer(&f,options,frames[0]);
+        renderer.addToScene(&scene);
+        unsigned int k = 0;
+        QBENCHMARK
+        {
+            renderer.setFrame(frames[k++ % frames.size()]);
+        }
+    }
+
+    // readData and reading every section out, against a writer that always has a new iteration
+    void sharedMemoryRead_data()
+    {
+        QTest::addColumn<int>("sections");
+        QTest::newRow("10 sections") << 10;
+        QTest::newRow("50 sections") << 50;
+        QTest::newRow("100 sections") << 100;
+    }
+
+    void sharedMemoryRead()
+    {
+        QFETCH(int,sections);
+        QString fileName = dir.filePath(QString("bench_%1.dat").arg(sections));
+        matlabSharedMemoryInterface reader(fileName);
+        QFile writerFile(fileName);
+        QVERIFY(writerFile.open(QIODevice::ReadWrite));
+        interfaceData * shared = reinterpret_cast<interfaceData*>(writerFile.map(0,sizeof(interfaceData)));
+        QVERIFY(shared);
+        shared->numSections = sections;
+        recordBytes(sizeof(interfaceData));
+        std::vector<snakeSectionData> out(sections);
+        int frames = 0;
+        QBENCHMARK
+        {
+            shared->writeHeartBeat++;
+            shared->iteration++;
+            shared->msgWritten = 1;
+            shared->turn = 1;
+            if(reader.readData())
+            {
+                for(int i = 0; i < reader.getNumberOfSections(); ++i)
+                {
+                    out[i] = reader.getSection(i);
+                }
+                ++frames;
+            }
+        }
+        QVERIFY(frames > 0);
+        writerFile.unmap(reinterpret_cast<uchar*>(shared));
+    }
+};
+
+// Turns the XML log of QtTest into JSON that can be compared between builds
+static bool writeJson(const QString & xmlFileName, const QString & jsonFileName)
+{
+    QFile xmlFile(xmlFileName);
+    if(!xmlFile.open(QIODevice::ReadOnly))
+    {
+        return false;
+    }
+    QJsonArray results;
+    QString function;
+    QXmlStreamReader xml(&xmlFile);
+    while(!xml.atEnd())
+    {
+        xml.readNext();
+        if(!xml.isStartElement())
+        {
+            continue;
+        }
+        if(xml.name() == "TestFunction")
+        {
+            function = xml.attributes().value("name").toString();
+        }
+        else if(xml.name() == "BenchmarkResult")
+        {
+            QJsonObject r;
+            const QString tag = xml.attributes().value("tag").toString();
+            const double value = xml.attributes().value("value").toDouble();
+            r["benchmark"] = function;
+            r["tag"] = tag;
+            r["metric"] = xml.attributes().value("metric").toString();
+            r["value"] = value;
+            r["iterations"] = xml.attributes().value("iterations").toInt();
+            const QString key = function + "/" + tag;
+            if(bytesPerIteration.contains(key) && r["metric"].toString() == "WalltimeMilliseconds" && value > 0.0)
+            {
+                r["bytes"] = double(bytesPerIteration[key]);
+                r["megabytesPerSecond"] = double(bytesPerIteration[key])/(value*1000.0);
+            }
+            if(maxErrors.contains(key))
+            {
+                r["maxError"] = maxErrors[key];
+            }
+            results.append(r);
+        }
+    }
+    QJsonObject root;
+    root["qtVersion"] = QString(qVersion());
+    root["buildAbi"] = QSysInfo::buildAbi();
+    root["idealThreadCount"] = QThread::idealThreadCount();
+    root["simd"] = QString(getSimdLevelName(getSimdKernels().level));
+    root["results"] = results;
+    QFile jsonFile(jsonFileName);
+    if(!jsonFile.open(QIODevice::WriteOnly))
+    {
+        return false;
+    }
+    jsonFile.write(QJsonDocument(root).toJson());
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    QApplication app(argc, argv);
+    QStringList args = app.arguments();
+    QString jsonFileName = "benchmarks.json";
+    int json = args.indexOf("--json");
+    if(json >= 0 && json+1 < args.size())
+    {
+        jsonFileName = args[json+1];
+        args.removeAt(json+1);
+        args.removeAt(json);
+    }
+    // Results go to the console as usual and to an XML log that is converted afterwards
+    QTemporaryDir logDir;
+    const QString xmlFileName = logDir.filePath("benchmarks.xml");
+    args << "-o" << (xmlFileName + ",xml") << "-o" << "-,txt";
+
+    // Everything but cachedOpen parses, the benchmark files would otherwise be cached
+    setRunCacheDirectory(QString());
+    datfBenchmarks benchmarks;
+    int result = QTest::qExec(&benchmarks,args);
+    if(!writeJson(xmlFileName,jsonFileName))
+    {
+        qWarning("Could not write %s",qPrintable(jsonFileName));
+        return 1;
+    }
+    return result;
+}
+
+#include "benchmarks.moc"
@@ -0,0 +1,29 @@
+#-------------------------------------------------
+#
+# Benchmarks of the loader, interpolation, kinematics and scene update
+#
+# Run ./benchmarks [--json results.json] [QtTest options]
+#
+#-------------------------------------------------
+
+QT       += core gui testlib
+QT       += concurrent
+
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+
+CONFIG += c++11
+CONFIG += console
+CONFIG -= app_bundle
+
+gcc:QMAKE_CXXFLAGS += -fno-math-errno
+
+TARGET = benchmarks
+TEMPLATE = app
+
+INCLUDEPATH += ..
+include(../core/core.pri)
+
+SOURCES += benchmarks.cpp
+
+HEADERS  += ../graphicsitems.h \
+    ../frameexporter.h
@@ -0,0 +1,11 @@
+# Links the core library, include from any project that uses it
+
+QT += concurrent
+
+INCLUDEPATH += $$PWD
+DEPENDPATH += $$PWD
+
+CORE_DESTDIR = $$shadowed($$PWD)
+LIBS += -L$$CORE_DESTDIR -lsnakecore
+win32-msvc*: PRE_TARGETDEPS += $$CORE_DESTDIR/snakecore.lib
+else: PRE_TARGETDEPS += $$CORE_DESTDIR/libsnakecore.a
@@ -0,0 +1,43 @@
+#-------------------------------------------------
+#
+# Data engine shared by the display, the tools and the benchmarks: .datf and shared memory
+# readers, frame sampling, kinematics and derived data. Only depends on QtCore.
+#
+# Built with its own optimisation flags, e.g. qmake CORE_CXXFLAGS="-march=native"
+#
+#-------------------------------------------------
+
+QT       += core concurrent
+QT       -= gui
+
+CONFIG += c++11
+CONFIG += staticlib
+CONFIG += optimize_full
+
+gcc:QMAKE_CXXFLAGS += -fno-math-errno
+QMAKE_CXXFLAGS += $$CORE_CXXFLAGS
+
+TARGET = snakecore
+TEMPLATE = lib
+DESTDIR = $$shadowed($$PWD)
+
+SOURCES += matlabinterface.cpp \
+    kinematics.cpp \
+    samplestore.cpp \
+    runcache.cpp \
+    simdkernels.cpp \
+    simdkernels_x86.cpp
+
+HEADERS  += matlabinterface.h \
+    samplestore.h \
+    runcache.h \
+    dimensions.h \
+    kinematics.h \
+    simdkernels.h \
+    prefetcher.h \
+    tracerecorder.h \
+    snakelayout.h \
+    runstatistics.h \
+    rangeindex.h \
+    segmenthash.h \
+    runcomparison.h
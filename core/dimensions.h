@@ -1,6 +1,9 @@
 #ifndef DIMENSIONS_H
 #define DIMENSIONS_H
 
+// Scene units per meter
+#define SCALE_ALL_FACTOR 400
+
 // Basically hardcode everything here, unit is meter
 template <unsigned int SCALE>
 class robot_dimensions
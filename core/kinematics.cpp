@@ -0,0 +1,75 @@
+#include "kinematics.h"
+#include "simdkernels.h"
+
+// Per thread scratch arrays, so poses can be computed on any number of threads without allocating
+struct kinematicsScratch
+{
+    std::vector<float> phi;
+    std::vector<float> rot;
+    std::vector<float> sinRot;
+    std::vector<float> cosRot;
+    std::vector<float> stepX;
+    std::vector<float> stepY;
+
+    void resize(int n)
+    {
+        phi.resize(n);
+        rot.resize(n);
+        sinRot.resize(n);
+        cosRot.resize(n);
+        stepX.resize(n);
+        stepY.resize(n);
+    }
+};
+
+// The rotation of a segment is the head angle plus the joint angles in front of it, and its centre
+// of mass is the head plus the offsets between the segments in front of it. Both are prefix sums,
+// the sums and the sines and cosines run in the SIMD kernels.
+template <unsigned int SCALE>
+void computeSegmentPoses(float headX, float headY, float headAngle,
+                         const std::vector<snakeSectionData> & sections,
+                         std::vector<segmentPose> & poses)
+{
+    typedef robot_dimensions<SCALE> RD;
+    const int n = int(sections.size());
+    poses.resize(n);
+    if(n == 0)
+    {
+        return;
+    }
+    static thread_local kinematicsScratch s;
+    s.resize(n);
+    const simdKernels & k = getSimdKernels();
+    s.phi[0] = 0.0f;
+    for(int i = 1; i < n; ++i)
+    {
+        s.phi[i] = sections[i-1].phi;
+    }
+    k.prefixSum(s.phi.data(),headAngle,s.rot.data(),n);
+    k.sinCos(s.rot.data(),s.sinRot.data(),s.cosRot.data(),n);
+    s.stepX[0] = headX*SCALE;
+    s.stepY[0] = headY*SCALE;
+    for(int i = 1; i < n; ++i)
+    {
+        const float back = RD::segmentMCtoBackwardJointConnection(i-1);
+        const float forward = RD::segmentMCtoForwardJointConnection(i);
+        s.stepX[i] = -(s.cosRot[i-1]*back + s.cosRot[i]*forward);
+        s.stepY[i] = -(s.sinRot[i-1]*back + s.sinRot[i]*forward);
+    }
+    k.prefixSum(s.stepX.data(),0.0f,s.stepX.data(),n);
+    k.prefixSum(s.stepY.data(),0.0f,s.stepY.data(),n);
+    for(int i = 0; i < n; ++i)
+    {
+        poses[i].x = s.stepX[i];
+        poses[i].y = s.stepY[i];
+        poses[i].rot = s.rot[i];
+    }
+}
+
+template void computeSegmentPoses<1>(float,float,float,const std::vector<snakeSectionData>&,std::vector<segmentPose>&);
+template void computeSegmentPoses<SCALE_ALL_FACTOR>(float,float,float,const std::vector<snakeSectionData>&,std::vector<segmentPose>&);
+
+void computeFramePoses(const snakeFrame & frame, std::vector<segmentPose> & poses)
+{
+    computeSegmentPoses<SCALE_ALL_FACTOR>(frame.headX,frame.headY,frame.headAngle,frame.sections,poses);
+}
@@ -0,0 +1,30 @@
+#ifndef KINEMATICS_H
+#define KINEMATICS_H
+
+#include <vector>
+#include "matlabinterface.h"
+#include "dimensions.h"
+
+// Position of the centre of mass of a segment and its absolute rotation in radians
+struct segmentPose
+{
+    float x;
+    float y;
+    float rot;
+};
+
+// Chains the segments from the head backwards, each joint angle is relative to the segment in front of it.
+// The head position is given in meters, the poses are returned in scene units. Compiled in the core
+// library for SCALE 1 and SCALE_ALL_FACTOR.
+template <unsigned int SCALE>
+void computeSegmentPoses(float headX, float headY, float headAngle,
+                         const std::vector<snakeSectionData> & sections,
+                         std::vector<segmentPose> & poses);
+
+extern template void computeSegmentPoses<1>(float,float,float,const std::vector<snakeSectionData>&,std::vector<segmentPose>&);
+extern template void computeSegmentPoses<SCALE_ALL_FACTOR>(float,float,float,const std::vector<snakeSectionData>&,std::vector<segmentPose>&);
+
+// Poses of all segments of a frame in scene units
+void computeFramePoses(const snakeFrame & frame, std::vector<segmentPose> & poses);
+
+#endif // KINEMATICS_H
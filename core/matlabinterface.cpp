@@ -0,0 +1,258 @@
+#include "matlabinterface.h"
+#include "simdkernels.h"
+#include "runcache.h"
+
+snakeAggregates computeAggregates(const std::vector<snakeSectionData> & sections)
+{
+    snakeAggregates a;
+    a.totalForceX = 0.0f;
+    a.totalForceY = 0.0f;
+    a.mcSpeedX = 0.0f;
+    a.mcSpeedY = 0.0f;
+    a.mcX = 0.0f;
+    a.mcY = 0.0f;
+    if(sections.empty())
+    {
+        return a;
+    }
+    float f = 1.0f/float(sections.size());
+    for(unsigned int i = 0; i < sections.size(); ++i)
+    {
+        a.totalForceX += sections[i].f_res_x;
+        a.totalForceY += sections[i].f_res_y;
+        a.mcSpeedX += f*sections[i].dx;
+        a.mcSpeedY += f*sections[i].dy;
+        a.mcX += f*sections[i].x;
+        a.mcY += f*sections[i].y;
+    }
+    return a;
+}
+
+matlabFileInterface::interpolationParameters matlabFileInterface::locate(float t, quint32 & cursor) const
+{
+    const float rho = 0.001f; // Simply snap to a sample if time is within this distance
+    interpolationParameters r;
+    r.i1 = 0;
+    r.i2 = 0;
+    r.scale = 0.0f;
+    if(numberOfSamples == 0)
+    {
+        return r;
+    }
+    if(cursor >= numberOfSamples)
+    {
+        cursor = numberOfSamples-1;
+    }
+    int steps = 0;
+    while(cursor+1 < numberOfSamples && position[cursor+1].t <= t && steps < 8)
+    {
+        ++cursor;
+        ++steps;
+    }
+    while(cursor > 0 && position[cursor].t > t && steps < 8)
+    {
+        --cursor;
+        ++steps;
+    }
+    if(steps == 8)
+    {
+        const fileRecord * i = std::upper_bound(position.begin(),position.begin()+numberOfSamples,t,
+                                                                     [](float v, const fileRecord & p){ return v < p.t; });
+        cursor = i == position.begin() ? 0 : quint32(i-position.begin())-1;
+    }
+    r.i1 = cursor;
+    r.i2 = cursor+1 < numberOfSamples ? cursor+1 : cursor;
+    float t1 = position[r.i1].t;
+    float t2 = position[r.i2].t;
+    if(t - t1 < rho || r.i1 == r.i2)
+    {
+        r.i2 = r.i1;
+    }
+    else if(t2 - t < rho)
+    {
+        r.i1 = r.i2;
+    }
+    else
+    {
+        r.scale = (t-t1)/(t2-t1);
+    }
+    return r;
+}
+
+void matlabFileInterface::sampleFrame(float t, quint32 & cursor, snakeFrame & f) const
+{
+    interpolationParameters p = locate(t,cursor);
+    f.t = t;
+    f.sample = cursor;
+    if(numberOfSamples == 0)
+    {
+        f.sections.resize(N);
+        f.headX = f.headY = f.headAngle = 0.0f;
+        f.aggregates = computeAggregates(f.sections);
+        return;
+    }
+    sampleFrame(p,f);
+}
+
+void matlabFileInterface::sampleFrame(const interpolationParameters & p, snakeFrame & f) const
+{
+    traceScope trace("sampleFrame");
+    f.sections.resize(N);
+    const fileRecord & r1 = position[p.i1];
+    const fileRecord & r2 = position[p.i2];
+    f.headX = r1.headPosX + p.scale*(r2.headPosX-r1.headPosX);
+    f.headY = r1.headPosY + p.scale*(r2.headPosY-r1.headPosY);
+    f.headAngle = r1.headAngle + p.scale*(r2.headAngle-r1.headAngle);
+    // A sample row is N consecutive structs of floats, interpolate it as one flat array. Compact
+    // rows are decoded into per thread buffers first.
+    static thread_local std::vector<snakeSectionData> rowA;
+    static thread_local std::vector<snakeSectionData> rowB;
+    rowA.resize(N);
+    rowB.resize(N);
+    const float * a = reinterpret_cast<const float*>(sections.getRow(p.i1,rowA.data()));
+    const float * b = p.i2 == p.i1 ? a : reinterpret_cast<const float*>(sections.getRow(p.i2,rowB.data()));
+    float * out = reinterpret_cast<float*>(f.sections.data());
+    getSimdKernels().interpolate(a,b,p.scale,out,int(N*(sizeof(snakeSectionData)/sizeof(float))));
+    f.aggregates = computeAggregates(f.sections);
+}
+
+matlabFileInterface::matlabFileInterface(QString fileName, sampleStorage storage) :
+    N(0),
+    numberOfSamples(0),
+    position(),
+    sections(),
+    file(fileName),
+    cacheMap(nullptr),
+    cacheUnsaved(false)
+{
+    for(int c = 0; c < NUMBER_OF_CHANNELS; ++c)
+    {
+        channelMin[c] = std::numeric_limits<float>::max();
+        channelMax[c] = -std::numeric_limits<float>::max();
+    }
+    if(file.exists())
+    {
+        traceScope trace("parse");
+        file.open(QIODevice::ReadOnly);
+        QDataStream in(&file);
+        in.setByteOrder(QDataStream::LittleEndian);
+        quint32 headerSamples = 0;
+        in >> N;
+        in >> headerSamples;
+        sections.reset(storage,N);
+        if(in.status() == QDataStream::Ok)
+        {
+            const bool cached = runCache::isWanted(file);
+            runCache::sourceKey key;
+            if(cached)
+            {
+                key = runCache::getKey(file);
+                if(runCache::load(key,storage,*this))
+                {
+                    return;
+                }
+                file.seek(HEADER_BYTES);
+            }
+            // A file still being written may not hold all the samples of its header yet
+            const qint64 count = std::min(qint64(headerSamples),getCompleteSamples());
+            position.reserve(size_t(count));
+            mcposition.reserve(size_t(count));
+            readSamples(in,count);
+            // Saving writes a copy of the run, left to the owner to do off the GUI thread
+            cacheKey = key;
+            cacheUnsaved = cached;
+        }
+    }
+}
+
+qint64 matlabFileInterface::getCompleteSamples()
+{
+    const qint64 recordBytes = qint64(sizeof(fileRecord)) + qint64(N)*qint64(sizeof(snakeSectionData));
+    return std::max(Q_INT64_C(0),(file.size()-HEADER_BYTES)/recordBytes);
+}
+
+bool matlabFileInterface::saveCache(const runStatistics * statistics)
+{
+    if(!cacheUnsaved)
+    {
+        return false;
+    }
+    cacheUnsaved = false;
+    return runCache::save(cacheKey,*this,statistics);
+}
+
+int matlabFileInterface::readAppendedSamples()
+{
+    if(!file.isOpen() || N == 0)
+    {
+        return 0;
+    }
+    traceScope trace("parse appended");
+    const qint64 added = getCompleteSamples()-numberOfSamples;
+    if(added <= 0)
+    {
+        return 0;
+    }
+    // The key no longer describes the samples held
+    cacheUnsaved = false;
+    const qint64 recordBytes = qint64(sizeof(fileRecord)) + qint64(N)*qint64(sizeof(snakeSectionData));
+    file.seek(HEADER_BYTES + qint64(numberOfSamples)*recordBytes);
+    QDataStream in(&file);
+    in.setByteOrder(QDataStream::LittleEndian);
+    return readSamples(in,added);
+}
+
+int matlabFileInterface::readSamples(QDataStream & in, qint64 count)
+{
+    in.setFloatingPointPrecision(QDataStream::SinglePrecision);
+    std::vector<snakeSectionData> row(N);
+    for(qint64 i = 0; i < count; ++i)
+    {
+        fileRecord r;
+        in >> r.t;
+        in >> r.headPosX;
+        in >> r.headPosY;
+        in >> r.headAngle;
+        position.push_back(r);
+        for(quint32 j = 0; j < N; ++j)
+        {
+            snakeSectionData & s = row[j];
+            in >> s.x;
+            in >> s.y;
+            in >> s.phi;
+            in >> s.dx;
+            in >> s.dy;
+            in >> s.d_phi;
+            in >> s.f_res_x;
+            in >> s.f_res_y;
+            in >> s.torque;
+            // Whole-run range of every channel, used to normalise colour maps
+            for(int c = 0; c < NUMBER_OF_CHANNELS; ++c)
+            {
+                float v = channelValue(s,c);
+                channelMin[c] = std::min(channelMin[c],v);
+                channelMax[c] = std::max(channelMax[c],v);
+            }
+        }
+        // Centre of mass of every sample is precomputed so the trail can be rebuilt on seek
+        snakeMCPos mc;
+        mc.t = r.t;
+        mc.x = 0.0f;
+        mc.y = 0.0f;
+        for(quint32 j = 0; j < N; ++j)
+        {
+            mc.x += row[j].x;
+            mc.y += row[j].y;
+        }
+        if(N > 0)
+        {
+            mc.x /= float(N);
+            mc.y /= float(N);
+        }
+        mcposition.push_back(mc);
+        sections.append(row.data());
+        ++numberOfSamples;
+    }
+    sections.finish();
+    return int(count);
+}
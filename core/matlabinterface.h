@@ -0,0 +1,383 @@
+#ifndef MATLABINTERFACE
+#define MATLABINTERFACE
+
+#include <QFile>
+#include <QString>
+#include <QDataStream>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <vector>
+#include "tracerecorder.h"
+#include "samplestore.h"
+#include "runcache.h"
+
+struct runStatistics;
+
+// Derived per-section quantities that segments can be coloured by
+enum sectionChannel
+{
+    CHANNEL_TORQUE,
+    CHANNEL_FORCE_MAGNITUDE,
+    CHANNEL_SPEED_MAGNITUDE,
+    NUMBER_OF_CHANNELS
+};
+
+inline float channelValue(const snakeSectionData & s, int channel)
+{
+    switch(channel)
+    {
+    case CHANNEL_TORQUE:
+        return s.torque;
+    case CHANNEL_FORCE_MAGNITUDE:
+        return std::sqrt(s.f_res_x*s.f_res_x + s.f_res_y*s.f_res_y);
+    case CHANNEL_SPEED_MAGNITUDE:
+        return std::sqrt(s.dx*s.dx + s.dy*s.dy);
+    }
+    return 0.0f;
+}
+
+struct snakeMCPos
+{
+    float t;
+    float x;
+    float y;
+};
+
+// Whole-snake quantities of one frame. Positions are in meters.
+struct snakeAggregates
+{
+    float totalForceX;
+    float totalForceY;
+    float mcSpeedX;
+    float mcSpeedY;
+    float mcX;
+    float mcY;
+};
+
+// Totals and centre of mass of all sections
+snakeAggregates computeAggregates(const std::vector<snakeSectionData> & sections);
+
+// Everything needed to draw the robot at one point in time
+struct snakeFrame
+{
+    float t;
+    int sample;             // Last sample at or before t, -1 when not read from a file
+    float headX;
+    float headY;
+    float headAngle;
+    std::vector<snakeSectionData> sections;
+    snakeAggregates aggregates;
+};
+
+struct interfaceData
+{
+    volatile quint32 turn;
+    quint32 readHeartBeat;
+    volatile quint32 writeHeartBeat;
+    volatile quint32 msgWritten;
+    quint32 msgRead;
+    quint32 iteration;
+    quint32 numSections;
+    float headPosX;
+    float headPosY;
+    float headAngle;
+    snakeSectionData section[100];
+};
+
+struct fileRecord
+{
+    float               t;
+    float               headPosX;
+    float               headPosY;
+    float               headAngle;
+};
+
+class matlabFileInterface
+{
+public:
+    struct interpolationParameters
+    {
+        int i1;
+        int i2;
+        float scale;
+    };
+
+    // The section count and sample count before the first record
+    enum { HEADER_BYTES = 8 };
+
+private:
+    friend class runCache;
+
+    quint32 N;
+    quint32 numberOfSamples;
+    sampleArray<fileRecord> position;
+    sampleStore sections;
+    sampleArray<snakeMCPos> mcposition;
+    float channelMin[NUMBER_OF_CHANNELS];
+    float channelMax[NUMBER_OF_CHANNELS];
+    QFile file;
+    QFile cache;            // Mapped run cache the arrays may be views of
+    const uchar * cacheMap; // Start of its mapping, null if the file was parsed
+    runCache::sourceKey cacheKey;
+    bool cacheUnsaved;      // Parsed although a cache was wanted, see saveCache
+
+    // Samples the file holds completely, whatever its header says
+    qint64 getCompleteSamples();
+    // Parses count samples from the current position of in and appends them
+    int readSamples(QDataStream & in, qint64 count);
+
+public:
+    // Finds the two samples around t. The search starts at cursor, which is left at the last
+    // sample at or before t, so playback moves it by a sample or two per call. Longer jumps fall
+    // back to a binary search. Does not touch the state of the object, so any number of threads
+    // can sample the same file as long as each keeps its own cursor.
+    interpolationParameters locate(float t, quint32 & cursor) const;
+
+    // Interpolates the whole frame at time t, including the aggregates
+    void sampleFrame(float t, quint32 & cursor, snakeFrame & f) const;
+
+    // Interpolates head, sections and aggregates between the two samples of p, leaves t and sample
+    void sampleFrame(const interpolationParameters & p, snakeFrame & f) const;
+
+    // Parses the whole file, an empty interface if it does not exist. The section data is kept in
+    // the given storage, see sampleStore. Large files are loaded from their cache if it is valid,
+    // see runCache.
+    matlabFileInterface(QString fileName, sampleStorage storage = getDefaultStorage());
+
+    // Writes the cache of a large file that had to be parsed, once, and returns whether it was
+    // written. Only reads the interface, so it can run on the thread pool while nothing appends.
+    // Statistics already computed for the run are stored as they are and must stay unchanged
+    // until it returns, otherwise they are computed.
+    bool saveCache(const runStatistics * statistics = nullptr);
+
+    // Parses the samples written to the end of the file since it was last read, for following a
+    // file that is still being written, and returns how many were added. Every complete sample
+    // counts, the number of samples in the header is not looked at. Nothing else may read the
+    // interface meanwhile.
+    int readAppendedSamples();
+
+    int getNumberOfSections() const
+    {
+        return N;
+    }
+    int getNumberOfSamples() const
+    {
+        return numberOfSamples;
+    }
+    float getChannelMin(int channel) const
+    {
+        return channelMin[channel];
+    }
+    float getChannelMax(int channel) const
+    {
+        return channelMax[channel];
+    }
+
+    float getSampleTime(int sample) const
+    {
+        return position[sample].t;
+    }
+
+    // Moves cursor one sample forward or back from the sample at or before t and returns the time
+    // of that sample. Stepping back from a time between two samples lands on the earlier one.
+    float stepSample(float t, quint32 & cursor, int direction) const
+    {
+        if(numberOfSamples == 0)
+        {
+            return 0.0f;
+        }
+        locate(t,cursor);
+        if(direction > 0)
+        {
+            if(cursor+1 < numberOfSamples)
+            {
+                ++cursor;
+            }
+        }
+        else if(direction < 0 && !(position[cursor].t < t) && cursor > 0)
+        {
+            --cursor;
+        }
+        return position[cursor].t;
+    }
+
+    snakeMCPos getMCPosition(int sample) const
+    {
+        return mcposition[sample];
+    }
+    snakeMCPos getHeadPosition(int sample) const
+    {
+        snakeMCPos p;
+        p.t = position[sample].t;
+        p.x = position[sample].headPosX;
+        p.y = position[sample].headPosY;
+        return p;
+    }
+    // All N sections of one recorded sample, contiguous. Points into the file data, or into buffer
+    // if the samples are stored compactly.
+    const snakeSectionData * getSampleSections(int sample, std::vector<snakeSectionData> & buffer) const
+    {
+        buffer.resize(N);
+        return sections.getRow(sample,buffer.data());
+    }
+    snakeSectionData getSampleSection(int sample, int section) const
+    {
+        return sections.getSection(sample,section);
+    }
+    const sampleStore & getSampleStore() const
+    {
+        return sections;
+    }
+    float get_lastTime() const
+    {
+        return numberOfSamples > 0 ? position[numberOfSamples-1].t : 0.0f;
+    }
+};
+
+class matlabSharedMemoryInterface
+{
+public:
+    matlabSharedMemoryInterface(QString fileName) :
+        mappedFile(fileName),
+        copy(),
+        notConnected(true),
+        iterationsWithoutWriteHeartbeat(0)
+    {
+        if(!mappedFile.exists())
+        {
+            mappedFile.open(QIODevice::ReadWrite);
+            mappedFile.setPermissions(QFileDevice::WriteOther | QFileDevice::ReadOther);
+            mappedFile.resize(sizeof(interfaceData));
+            mappedFile.close();
+        }
+        mappedFile.open(QIODevice::ReadWrite);
+        mappedFile.setPermissions(QFileDevice::WriteOther | QFileDevice::ReadOther);
+        file = mappedFile.map(0,mappedFile.size());
+        mappedFile.close();
+        if(!file)
+        {
+            // File not successfully mapped
+        }
+        else
+        {
+            reinterpret_cast<interfaceData*>(file)->turn = 0;
+            reinterpret_cast<interfaceData*>(file)->msgRead = true;
+            reinterpret_cast<interfaceData*>(file)->readHeartBeat++;
+            lastWriteHeartBeat = reinterpret_cast<interfaceData*>(file)->writeHeartBeat;
+            lastIteration = reinterpret_cast<interfaceData*>(file)->iteration;
+        }
+    }
+    ~matlabSharedMemoryInterface()
+    {
+        mappedFile.unmap(file);
+    }
+
+    bool readData()
+    {
+        traceScope trace("readData");
+        reinterpret_cast<interfaceData*>(file)->readHeartBeat++;    // This process is listening to matlab
+        quint32 whb = reinterpret_cast<interfaceData*>(file)->writeHeartBeat;
+        // Find out if matlab side is connected or not.
+        if(lastWriteHeartBeat == whb)
+        {
+            iterationsWithoutWriteHeartbeat++;
+            if(iterationsWithoutWriteHeartbeat > 100)
+            {
+                notConnected = true;
+            }
+            return false;
+        }
+        else
+        {
+            notConnected = false;
+            iterationsWithoutWriteHeartbeat = 0;
+            lastWriteHeartBeat = whb;
+        }
+
+        // Entering read when condition is met
+        while(!reinterpret_cast<interfaceData*>(file)->msgWritten ||
+              reinterpret_cast<interfaceData*>(file)->turn == 0);
+        reinterpret_cast<interfaceData*>(file)->msgRead = false;    // Gains exclusive access to data
+        if(reinterpret_cast<interfaceData*>(file)->iteration == lastIteration) // Cancel update if nothing happened
+        {
+            reinterpret_cast<interfaceData*>(file)->msgRead = true;
+            return false;
+        }
+        lastIteration = reinterpret_cast<interfaceData*>(file)->iteration;
+        copy = *reinterpret_cast<interfaceData*>(file);
+        reinterpret_cast<interfaceData*>(file)->msgRead = true;
+        reinterpret_cast<interfaceData*>(file)->turn = 0;
+
+        return true;
+    }
+
+    bool isConnectionProbablyMissing()
+    {
+        return notConnected;
+    }
+
+    int getNumberOfSections()
+    {
+        return copy.numSections;
+    }
+    snakeSectionData getSection(int s)
+    {
+        traceScope trace("getSection");
+        return copy.section[s];
+    }
+
+    int getIteration()
+    {
+        return copy.iteration;
+    }
+
+    int getReadHeartbeat()
+    {
+        return reinterpret_cast<interfaceData*>(file)->readHeartBeat;
+    }
+    int getWriteHeartbeat()
+    {
+        return reinterpret_cast<interfaceData*>(file)->writeHeartBeat;
+    }
+    int getTurn()
+    {
+        return reinterpret_cast<interfaceData*>(file)->turn;
+    }
+    float get_headX()
+    {
+        return copy.headPosX;
+    }
+    float get_headY()
+    {
+        return copy.headPosY;
+    }
+    float get_headAngle()
+    {
+        return copy.headAngle;
+    }
+
+    bool messageWritten()
+    {
+        return reinterpret_cast<interfaceData*>(file)->msgWritten;
+    }
+    bool messageRead()
+    {
+        return reinterpret_cast<interfaceData*>(file)->msgRead;
+    }
+
+private:
+
+    QFile mappedFile;
+    uchar * file;
+    interfaceData copy;
+    int lastIteration;
+    int lastWriteHeartBeat;
+    bool notConnected;
+    int iterationsWithoutWriteHeartbeat;
+
+
+};
+
+#endif // MATLABINTERFACE
+
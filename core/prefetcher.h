@@ -0,0 +1,190 @@
+#ifndef PREFETCHER_H
+#define PREFETCHER_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <cmath>
+#include "matlabinterface.h"
+
+// Producer thread that runs ahead of the playback clock of a file, interpolating frames and their
+// aggregates into a small ring of ready frames. Frames are spaced by the simulation time one
+// display frame covers, in the current playback direction. The render tick takes the frame
+// matching its clock and only falls back to sampling on the GUI thread on a miss.
+class framePrefetcher
+{
+public:
+    enum { QUEUE_LENGTH = 8 };
+
+    framePrefetcher(const matlabFileInterface * file) :
+        file(file),
+        ring(QUEUE_LENGTH),
+        first(0),
+        count(0),
+        active(false),
+        quit(false),
+        sampling(false),
+        generation(0),
+        nextTime(0.0f),
+        step(0.0f)
+    {
+        worker = std::thread(&framePrefetcher::run,this);
+    }
+
+    ~framePrefetcher()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        wakeProducer.notify_all();
+        worker.join();
+    }
+
+    // Starts producing frames from time t, each step of simulation time apart. step is negative
+    // for reverse playback. Anything already queued is thrown away.
+    void start(float t, float frameStep)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        invalidate();
+        nextTime = t;
+        step = frameStep;
+        active = step != 0.0f;
+        wakeProducer.notify_all();
+    }
+
+    void stop()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        invalidate();
+        active = false;
+    }
+
+    // Stops like stop and also waits for the frame being sampled, so the file can be changed.
+    // start resumes.
+    void stopAndWait()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        invalidate();
+        active = false;
+        idle.wait(lock,[this]{ return !sampling; });
+    }
+
+    // Seek, the queue is dropped immediately and production restarts at t
+    void seek(float t)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        invalidate();
+        nextTime = t;
+        wakeProducer.notify_all();
+    }
+
+    // Hands out the queued frame closest to t if it is within half a step. Older frames are
+    // discarded. The frame is swapped into out, so no sections are copied.
+    bool take(float t, snakeFrame & out)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(!active)
+        {
+            return false;
+        }
+        const float tolerance = 0.5f*std::abs(step);
+        // Drop frames the clock has already passed
+        while(count > 0 && behind(ring[first].t,t) && std::abs(ring[first].t-t) > tolerance)
+        {
+            pop();
+        }
+        if(count == 0 || std::abs(ring[first].t-t) > tolerance)
+        {
+            if(count == 0 || !behind(t,ring[first].t))
+            {
+                // The producer is behind the clock, continue from the clock instead of catching up
+                invalidate();
+                nextTime = t+step;
+            }
+            wakeProducer.notify_all();
+            return false;
+        }
+        std::swap(ring[first],out);
+        pop();
+        wakeProducer.notify_all();
+        return true;
+    }
+
+private:
+    const matlabFileInterface * file;
+    std::vector<snakeFrame> ring;
+    int first;
+    int count;
+    bool active;
+    bool quit;
+    bool sampling;
+    quint32 generation;
+    float nextTime;
+    float step;
+    std::mutex mutex;
+    std::condition_variable wakeProducer;
+    std::condition_variable idle;
+    std::thread worker;
+
+    // Whether time a comes before b in the playback direction
+    bool behind(float a, float b) const
+    {
+        return step >= 0.0f ? a < b : a > b;
+    }
+
+    void invalidate()
+    {
+        first = 0;
+        count = 0;
+        ++generation;
+    }
+
+    void pop()
+    {
+        first = (first+1) % QUEUE_LENGTH;
+        --count;
+    }
+
+    void run()
+    {
+        traceRecorder::setThreadName("prefetcher");
+        snakeFrame scratch;
+        quint32 localCursor = 0;
+        std::unique_lock<std::mutex> lock(mutex);
+        while(true)
+        {
+            wakeProducer.wait(lock,[this]{ return quit || (active && count < QUEUE_LENGTH && inRange(nextTime)); });
+            if(quit)
+            {
+                return;
+            }
+            const quint32 gen = generation;
+            const float t = nextTime;
+            sampling = true;
+            lock.unlock();
+            {
+                traceScope trace("prefetch frame");
+                file->sampleFrame(t,localCursor,scratch);
+            }
+            lock.lock();
+            sampling = false;
+            idle.notify_all();
+            if(gen != generation)
+            {
+                continue; // Seeked while sampling
+            }
+            std::swap(ring[(first+count) % QUEUE_LENGTH],scratch);
+            ++count;
+            nextTime += step;
+        }
+    }
+
+    bool inRange(float t) const
+    {
+        return file->getNumberOfSamples() > 0 && t >= 0.0f && t <= file->get_lastTime()+std::abs(step);
+    }
+};
+
+#endif // PREFETCHER_H
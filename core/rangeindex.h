@@ -0,0 +1,322 @@
+#ifndef RANGEINDEX_H
+#define RANGEINDEX_H
+
+#include <QtConcurrent/QtConcurrent>
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include "matlabinterface.h"
+
+// Min/max summary of every channel of every section over the samples of a file, for finding the
+// next sample where a value crosses a threshold and where a channel peaks. The samples are
+// grouped in blocks of BLOCK_SIZE and a segment tree of block minima and maxima sits on top, so a
+// search is O(log n) steps through the tree plus at most two block scans.
+class channelRangeIndex
+{
+public:
+    enum { BLOCK_SIZE = 32 };
+    // Blocks summarised by one task of a build
+    enum { BLOCKS_PER_RUN = 64 };
+
+    channelRangeIndex() :
+        file(nullptr),
+        numberOfSamples(0),
+        numberOfSections(0),
+        leaves(0)
+    {
+    }
+
+    // Builds the trees of all channels and sections. The leaves are taken from the run cache if
+    // the file was loaded from one. Otherwise runs of blocks are summarised in parallel, every row
+    // is read once and feeds the leaves of all trees. Then the trees are completed.
+    void build(const matlabFileInterface * f)
+    {
+        file = f;
+        numberOfSamples = f->getNumberOfSamples();
+        numberOfSections = f->getNumberOfSections();
+        const int numberOfBlocks = (numberOfSamples+BLOCK_SIZE-1)/BLOCK_SIZE;
+        leaves = 1;
+        while(leaves < numberOfBlocks)
+        {
+            leaves *= 2;
+        }
+        trees.assign(size_t(NUMBER_OF_CHANNELS)*numberOfSections,tree());
+        for(unsigned int i = 0; i < trees.size(); ++i)
+        {
+            trees[i].index = this;
+            trees[i].minima.assign(2*leaves,std::numeric_limits<float>::max());
+            trees[i].maxima.assign(2*leaves,-std::numeric_limits<float>::max());
+        }
+        const float * cachedMinima;
+        const float * cachedMaxima;
+        if(runCache::getRangeLeaves(*f,cachedMinima,cachedMaxima))
+        {
+            for(unsigned int t = 0; t < trees.size(); ++t)
+            {
+                const size_t first = size_t(t)*numberOfBlocks;
+                std::copy(cachedMinima+first,cachedMinima+first+numberOfBlocks,trees[t].minima.begin()+leaves);
+                std::copy(cachedMaxima+first,cachedMaxima+first+numberOfBlocks,trees[t].maxima.begin()+leaves);
+            }
+        }
+        else
+        {
+            std::vector<blockRun> runs;
+            for(int first = 0; first < numberOfBlocks; first += BLOCKS_PER_RUN)
+            {
+                blockRun r;
+                r.index = this;
+                r.firstBlock = first;
+                r.lastBlock = std::min(numberOfBlocks,first+BLOCKS_PER_RUN);
+                runs.push_back(r);
+            }
+            QtConcurrent::blockingMap(runs,summariseRun);
+        }
+        QtConcurrent::blockingMap(trees,completeTree);
+    }
+
+    // The block minima and maxima of every tree, tree after tree, as the run cache keeps them
+    void getLeaves(std::vector<float> & minima, std::vector<float> & maxima) const
+    {
+        const int numberOfBlocks = (numberOfSamples+BLOCK_SIZE-1)/BLOCK_SIZE;
+        minima.clear();
+        maxima.clear();
+        minima.reserve(trees.size()*numberOfBlocks);
+        maxima.reserve(trees.size()*numberOfBlocks);
+        for(unsigned int t = 0; t < trees.size(); ++t)
+        {
+            minima.insert(minima.end(),trees[t].minima.begin()+leaves,trees[t].minima.begin()+leaves+numberOfBlocks);
+            maxima.insert(maxima.end(),trees[t].maxima.begin()+leaves,trees[t].maxima.begin()+leaves+numberOfBlocks);
+        }
+    }
+
+    void clear()
+    {
+        file = nullptr;
+        numberOfSamples = 0;
+        numberOfSections = 0;
+        trees.clear();
+    }
+
+    // First sample after 'from' where the channel of the section is above the threshold, or -1.
+    // A negative section searches all sections and returns the earliest hit.
+    int findNextAbove(int channel, int section, float threshold, int from) const
+    {
+        return findNext(channel,section,threshold,from,true);
+    }
+
+    // First sample after 'from' where the channel of the section is below the threshold, or -1
+    int findNextBelow(int channel, int section, float threshold, int from) const
+    {
+        return findNext(channel,section,threshold,from,false);
+    }
+
+    // Sample where the channel of the section has its largest value, or -1. A negative section
+    // looks at all sections.
+    int findMaximum(int channel, int section) const
+    {
+        if(!file || numberOfSamples == 0)
+        {
+            return -1;
+        }
+        if(section < 0)
+        {
+            int best = -1;
+            float bestValue = -std::numeric_limits<float>::max();
+            for(int s = 0; s < numberOfSections; ++s)
+            {
+                const tree & t = getTree(channel,s);
+                if(t.maxima[1] > bestValue)
+                {
+                    bestValue = t.maxima[1];
+                    best = s;
+                }
+            }
+            return best < 0 ? -1 : findMaximum(channel,best);
+        }
+        // Follow the child holding the maximum down to a block, then find it in the block
+        const tree & t = getTree(channel,section);
+        int node = 1;
+        while(node < leaves)
+        {
+            node = t.maxima[2*node] >= t.maxima[2*node+1] ? 2*node : 2*node+1;
+        }
+        const int first = (node-leaves)*BLOCK_SIZE;
+        const int last = std::min(numberOfSamples,first+BLOCK_SIZE);
+        int best = first;
+        for(int i = first; i < last; ++i)
+        {
+            if(getValue(channel,section,i) > getValue(channel,section,best))
+            {
+                best = i;
+            }
+        }
+        return best;
+    }
+
+    float getMaximum(int channel, int section) const
+    {
+        return getTree(channel,section).maxima[1];
+    }
+
+    float getMinimum(int channel, int section) const
+    {
+        return getTree(channel,section).minima[1];
+    }
+
+private:
+    struct tree
+    {
+        const channelRangeIndex * index;
+        // Heap layout, node 1 is the root and the blocks are the nodes from 'leaves' up
+        std::vector<float> minima;
+        std::vector<float> maxima;
+    };
+
+    // Blocks [firstBlock,lastBlock), runs write disjoint leaves so they can be built at once
+    struct blockRun
+    {
+        channelRangeIndex * index;
+        int firstBlock;
+        int lastBlock;
+    };
+
+    // Reads the rows of a run once, decoded if the storage is compact, and writes the minimum
+    // and maximum of every channel and section of each block into the leaves
+    static void summariseRun(blockRun & r)
+    {
+        traceScope trace("range index");
+        channelRangeIndex * index = r.index;
+        const int sections = index->numberOfSections;
+        std::vector<snakeSectionData> buffer(sections);
+        std::vector<float> minima(size_t(NUMBER_OF_CHANNELS)*sections);
+        std::vector<float> maxima(minima.size());
+        for(int block = r.firstBlock; block < r.lastBlock; ++block)
+        {
+            std::fill(minima.begin(),minima.end(),std::numeric_limits<float>::max());
+            std::fill(maxima.begin(),maxima.end(),-std::numeric_limits<float>::max());
+            const int last = std::min(index->numberOfSamples,(block+1)*BLOCK_SIZE);
+            for(int i = block*BLOCK_SIZE; i < last; ++i)
+            {
+                const snakeSectionData * row = index->file->getSampleSections(i,buffer);
+                for(int channel = 0; channel < NUMBER_OF_CHANNELS; ++channel)
+                {
+                    float * lo = &minima[size_t(channel)*sections];
+                    float * hi = &maxima[size_t(channel)*sections];
+                    for(int section = 0; section < sections; ++section)
+                    {
+                        const float v = channelValue(row[section],channel);
+                        lo[section] = std::min(lo[section],v);
+                        hi[section] = std::max(hi[section],v);
+                    }
+                }
+            }
+            const int node = index->leaves + block;
+            for(unsigned int t = 0; t < index->trees.size(); ++t)
+            {
+                index->trees[t].minima[node] = minima[t];
+                index->trees[t].maxima[node] = maxima[t];
+            }
+        }
+    }
+
+    static void completeTree(tree & t)
+    {
+        for(int node = t.index->leaves-1; node > 0; --node)
+        {
+            t.minima[node] = std::min(t.minima[2*node],t.minima[2*node+1]);
+            t.maxima[node] = std::max(t.maxima[2*node],t.maxima[2*node+1]);
+        }
+    }
+
+    const tree & getTree(int channel, int section) const
+    {
+        return trees[size_t(channel)*numberOfSections + section];
+    }
+
+    float getValue(int channel, int section, int sample) const
+    {
+        return channelValue(file->getSampleSection(sample,section),channel);
+    }
+
+    bool matches(float v, float threshold, bool above) const
+    {
+        return above ? v > threshold : v < threshold;
+    }
+
+    bool blockMatches(const tree & t, int node, float threshold, bool above) const
+    {
+        return above ? t.maxima[node] > threshold : t.minima[node] < threshold;
+    }
+
+    int scanBlock(int channel, int section, float threshold, bool above, int first, int last) const
+    {
+        for(int i = first; i < last; ++i)
+        {
+            if(matches(getValue(channel,section,i),threshold,above))
+            {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    int findNext(int channel, int section, float threshold, int from, bool above) const
+    {
+        if(!file || numberOfSamples == 0)
+        {
+            return -1;
+        }
+        if(section < 0)
+        {
+            int best = -1;
+            for(int s = 0; s < numberOfSections; ++s)
+            {
+                int hit = findNext(channel,s,threshold,from,above);
+                if(hit >= 0 && (best < 0 || hit < best))
+                {
+                    best = hit;
+                }
+            }
+            return best;
+        }
+        const int start = std::max(0,from+1);
+        if(start >= numberOfSamples)
+        {
+            return -1;
+        }
+        // Rest of the block the search starts in
+        const int startBlock = start/BLOCK_SIZE;
+        int hit = scanBlock(channel,section,threshold,above,start,std::min(numberOfSamples,(startBlock+1)*BLOCK_SIZE));
+        if(hit >= 0)
+        {
+            return hit;
+        }
+        // Climb from the starting block until a subtree to the right can match, then descend
+        // into its leftmost matching block
+        const tree & t = getTree(channel,section);
+        int node = leaves + startBlock;
+        while(node > 1)
+        {
+            if((node & 1) == 0 && blockMatches(t,node+1,threshold,above))
+            {
+                node = node+1;
+                while(node < leaves)
+                {
+                    node = blockMatches(t,2*node,threshold,above) ? 2*node : 2*node+1;
+                }
+                const int first = (node-leaves)*BLOCK_SIZE;
+                return scanBlock(channel,section,threshold,above,first,std::min(numberOfSamples,first+BLOCK_SIZE));
+            }
+            node /= 2;
+        }
+        return -1;
+    }
+
+    const matlabFileInterface * file;
+    int numberOfSamples;
+    int numberOfSections;
+    int leaves;
+    std::vector<tree> trees;
+};
+
+#endif // RANGEINDEX_H
@@ -0,0 +1,357 @@
+#include "runcache.h"
+#include "matlabinterface.h"
+#include "runstatistics.h"
+#include "rangeindex.h"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <mutex>
+#include <cstring>
+
+static std::mutex & settingsMutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
+static bool directoryChosen = false;
+static QString directory;
+
+QString getRunCacheDirectory()
+{
+    std::lock_guard<std::mutex> lock(settingsMutex());
+    if(!directoryChosen)
+    {
+        directory = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+        if(!directory.isEmpty())
+        {
+            directory += "/runs";
+        }
+        directoryChosen = true;
+    }
+    return directory;
+}
+
+void setRunCacheDirectory(const QString & d)
+{
+    std::lock_guard<std::mutex> lock(settingsMutex());
+    directory = d;
+    directoryChosen = true;
+}
+
+enum cacheArray
+{
+    ARRAY_POSITION,
+    ARRAY_MC_POSITION,
+    ARRAY_ROWS,
+    ARRAY_PACKED,
+    ARRAY_CHUNK_OFFSET,
+    ARRAY_CHUNK_SCALE,
+    ARRAY_PENDING,
+    ARRAY_MAX_TORQUE,
+    ARRAY_RMS_TORQUE,
+    ARRAY_RANGE_MINIMA,
+    ARRAY_RANGE_MAXIMA,
+    NUMBER_OF_ARRAYS
+};
+
+// Arrays start on cache lines so the views are aligned for the kernels
+enum { ARRAY_ALIGNMENT = 64 };
+enum { CACHE_VERSION = 2 };
+static const char cacheMagic[8] = { 'S','N','K','C','A','C','H','E' };
+
+struct cacheHeader
+{
+    char magic[8];
+    quint32 version;
+    quint32 storage;
+    quint32 sections;
+    quint32 samples;
+    qint64 sourceSize;
+    qint64 sourceModified;
+    char sourceHash[20];
+    qint32 pendingRows;
+    qint32 pendingEncoded;
+    float channelMin[NUMBER_OF_CHANNELS];
+    float channelMax[NUMBER_OF_CHANNELS];
+    float maxError[sampleStore::FLOATS_PER_SECTION];
+    float pendingError[sampleStore::FLOATS_PER_SECTION];
+    float duration;         // runStatistics, the torques of the joints are arrays
+    float cmDistance;
+    float averageForwardSpeed;
+    float peakForce;
+    float peakForceTime;
+    qint32 peakForceSection;
+    qint32 rangeBlockSize;  // Samples per leaf of the range index
+    qint64 offset[NUMBER_OF_ARRAYS];
+    qint64 count[NUMBER_OF_ARRAYS];
+};
+
+static qint64 alignUp(qint64 v)
+{
+    return (v + ARRAY_ALIGNMENT-1) & ~qint64(ARRAY_ALIGNMENT-1);
+}
+
+static qint64 getRangeLeafCount(quint32 sections, quint32 samples)
+{
+    const qint64 blocks = (qint64(samples) + channelRangeIndex::BLOCK_SIZE-1)/channelRangeIndex::BLOCK_SIZE;
+    return qint64(NUMBER_OF_CHANNELS)*sections*blocks;
+}
+
+// Header of the cache f was loaded from, null if there is none or f has grown since
+static const cacheHeader * getLoadedHeader(const uchar * map, quint32 samples)
+{
+    const cacheHeader * h = reinterpret_cast<const cacheHeader*>(map);
+    return h && h->samples == samples ? h : nullptr;
+}
+
+bool runCache::isWanted(const QFile & source)
+{
+    return source.size() >= MIN_SOURCE_BYTES && !getRunCacheDirectory().isEmpty();
+}
+
+runCache::sourceKey runCache::getKey(QFile & source)
+{
+    // The head and tail and blocks in between, enough to notice a rewritten run of the same size
+    const qint64 blockBytes = 64 << 10;
+    const int blocks = 16;
+    QFileInfo info(source.fileName());
+    sourceKey key;
+    key.path = info.absoluteFilePath();
+    key.size = source.size();
+    key.modified = info.lastModified().toMSecsSinceEpoch();
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    for(int b = 0; b <= blocks; ++b)
+    {
+        const qint64 offset = std::max(Q_INT64_C(0),std::min(key.size-blockBytes,(key.size-blockBytes)*b/blocks));
+        source.seek(offset);
+        hash.addData(source.read(blockBytes));
+    }
+    key.hash = hash.result();
+    return key;
+}
+
+QString runCache::getCacheFileName(const sourceKey & key, sampleStorage storage)
+{
+    const QByteArray name = QCryptographicHash::hash(key.path.toUtf8(),QCryptographicHash::Sha1).toHex();
+    return getRunCacheDirectory() + "/" + QString::fromLatin1(name) + "." + getStorageName(storage) + ".datc";
+}
+
+bool runCache::load(const sourceKey & key, sampleStorage storage, matlabFileInterface & f)
+{
+    traceScope trace("cache load");
+    QFile & cache = f.cache;
+    cache.setFileName(getCacheFileName(key,storage));
+    if(!cache.open(QIODevice::ReadOnly) || cache.size() < qint64(sizeof(cacheHeader)))
+    {
+        cache.close();
+        return false;
+    }
+    const qint64 cacheSize = cache.size();
+    uchar * map = cache.map(0,cacheSize);
+    if(!map)
+    {
+        cache.close();
+        return false;
+    }
+    cacheHeader h;
+    std::memcpy(&h,map,sizeof(h));
+    const qint64 rowFloats = qint64(f.N)*sampleStore::FLOATS_PER_SECTION;
+    const qint64 chunks = (qint64(h.samples) + sampleStore::CHUNK_SAMPLES-1)/sampleStore::CHUNK_SAMPLES;
+    qint64 expected[NUMBER_OF_ARRAYS];
+    expected[ARRAY_POSITION] = h.samples;
+    expected[ARRAY_MC_POSITION] = h.samples;
+    expected[ARRAY_ROWS] = storage == STORAGE_FLOAT32 ? qint64(h.samples)*f.N : 0;
+    expected[ARRAY_PACKED] = storage == STORAGE_FLOAT32 ? 0 : qint64(h.samples)*rowFloats;
+    expected[ARRAY_CHUNK_OFFSET] = storage == STORAGE_INT16 ? chunks*rowFloats : 0;
+    expected[ARRAY_CHUNK_SCALE] = expected[ARRAY_CHUNK_OFFSET];
+    expected[ARRAY_PENDING] = qint64(h.pendingRows)*rowFloats;
+    expected[ARRAY_MAX_TORQUE] = h.samples > 0 ? std::max(0,int(f.N)-1) : 0;
+    expected[ARRAY_RMS_TORQUE] = expected[ARRAY_MAX_TORQUE];
+    expected[ARRAY_RANGE_MINIMA] = getRangeLeafCount(f.N,h.samples);
+    expected[ARRAY_RANGE_MAXIMA] = expected[ARRAY_RANGE_MINIMA];
+    const qint64 elementBytes[NUMBER_OF_ARRAYS] =
+    {
+        sizeof(fileRecord), sizeof(snakeMCPos), sizeof(snakeSectionData), sizeof(quint16),
+        sizeof(float), sizeof(float), sizeof(float), sizeof(float), sizeof(float), sizeof(float), sizeof(float)
+    };
+    bool valid = std::memcmp(h.magic,cacheMagic,sizeof(cacheMagic)) == 0 &&
+                 h.version == CACHE_VERSION &&
+                 h.storage == quint32(storage) &&
+                 h.sections == f.N &&
+                 h.sourceSize == key.size &&
+                 h.sourceModified == key.modified &&
+                 key.hash.size() == int(sizeof(h.sourceHash)) &&
+                 std::memcmp(h.sourceHash,key.hash.constData(),sizeof(h.sourceHash)) == 0 &&
+                 h.pendingRows >= 0 && h.pendingRows < sampleStore::CHUNK_SAMPLES &&
+                 h.rangeBlockSize == channelRangeIndex::BLOCK_SIZE;
+    for(int a = 0; a < NUMBER_OF_ARRAYS && valid; ++a)
+    {
+        valid = h.count[a] == expected[a] && h.offset[a] >= qint64(sizeof(h)) &&
+                h.offset[a] % ARRAY_ALIGNMENT == 0 && h.offset[a] + h.count[a]*elementBytes[a] <= cacheSize;
+    }
+    if(!valid)
+    {
+        cache.unmap(map);
+        cache.close();
+        return false;
+    }
+
+    f.cacheMap = map;
+    f.numberOfSamples = h.samples;
+    std::copy(h.channelMin,h.channelMin+NUMBER_OF_CHANNELS,f.channelMin);
+    std::copy(h.channelMax,h.channelMax+NUMBER_OF_CHANNELS,f.channelMax);
+    f.position.setView(reinterpret_cast<const fileRecord*>(map + h.offset[ARRAY_POSITION]),size_t(h.count[ARRAY_POSITION]));
+    f.mcposition.setView(reinterpret_cast<const snakeMCPos*>(map + h.offset[ARRAY_MC_POSITION]),size_t(h.count[ARRAY_MC_POSITION]));
+    sampleStore & s = f.sections;
+    s.reset(storage,f.N);
+    s.samples = h.samples;
+    s.rows.setView(reinterpret_cast<const snakeSectionData*>(map + h.offset[ARRAY_ROWS]),size_t(h.count[ARRAY_ROWS]));
+    s.packed.setView(reinterpret_cast<const quint16*>(map + h.offset[ARRAY_PACKED]),size_t(h.count[ARRAY_PACKED]));
+    s.chunkOffset.setView(reinterpret_cast<const float*>(map + h.offset[ARRAY_CHUNK_OFFSET]),size_t(h.count[ARRAY_CHUNK_OFFSET]));
+    s.chunkScale.setView(reinterpret_cast<const float*>(map + h.offset[ARRAY_CHUNK_SCALE]),size_t(h.count[ARRAY_CHUNK_SCALE]));
+    const float * pending = reinterpret_cast<const float*>(map + h.offset[ARRAY_PENDING]);
+    s.pending.assign(pending,pending+h.count[ARRAY_PENDING]);
+    s.pendingRows = h.pendingRows;
+    s.pendingEncoded = h.pendingEncoded != 0;
+    std::copy(h.maxError,h.maxError+sampleStore::FLOATS_PER_SECTION,s.maxError);
+    std::copy(h.pendingError,h.pendingError+sampleStore::FLOATS_PER_SECTION,s.pendingError);
+    return true;
+}
+
+bool runCache::getStatistics(const matlabFileInterface & f, runStatistics & statistics)
+{
+    const cacheHeader * h = getLoadedHeader(f.cacheMap,f.numberOfSamples);
+    if(!h)
+    {
+        return false;
+    }
+    const float * maxTorque = reinterpret_cast<const float*>(f.cacheMap + h->offset[ARRAY_MAX_TORQUE]);
+    const float * rmsTorque = reinterpret_cast<const float*>(f.cacheMap + h->offset[ARRAY_RMS_TORQUE]);
+    statistics.maxTorque.assign(maxTorque,maxTorque+h->count[ARRAY_MAX_TORQUE]);
+    statistics.rmsTorque.assign(rmsTorque,rmsTorque+h->count[ARRAY_RMS_TORQUE]);
+    statistics.duration = h->duration;
+    statistics.cmDistance = h->cmDistance;
+    statistics.averageForwardSpeed = h->averageForwardSpeed;
+    statistics.peakForce = h->peakForce;
+    statistics.peakForceTime = h->peakForceTime;
+    statistics.peakForceSection = h->peakForceSection;
+    return true;
+}
+
+bool runCache::getRangeLeaves(const matlabFileInterface & f, const float *& minima, const float *& maxima)
+{
+    const cacheHeader * h = getLoadedHeader(f.cacheMap,f.numberOfSamples);
+    if(!h)
+    {
+        return false;
+    }
+    minima = reinterpret_cast<const float*>(f.cacheMap + h->offset[ARRAY_RANGE_MINIMA]);
+    maxima = reinterpret_cast<const float*>(f.cacheMap + h->offset[ARRAY_RANGE_MAXIMA]);
+    return true;
+}
+
+bool runCache::save(const sourceKey & key, const matlabFileInterface & f, const runStatistics * statistics)
+{
+    traceScope trace("cache save");
+    const sampleStore & s = f.sections;
+    if(!QDir().mkpath(getRunCacheDirectory()))
+    {
+        return false;
+    }
+    // The derived data is read back on every open, computing it here once spares all of them
+    const runStatistics r = statistics ? *statistics : runStatisticsEngine::compute(&f);
+    channelRangeIndex index;
+    index.build(&f);
+    std::vector<float> rangeMinima;
+    std::vector<float> rangeMaxima;
+    index.getLeaves(rangeMinima,rangeMaxima);
+    cacheHeader h;
+    std::memset(&h,0,sizeof(h));
+    std::memcpy(h.magic,cacheMagic,sizeof(cacheMagic));
+    h.version = CACHE_VERSION;
+    h.storage = s.storage;
+    h.sections = f.N;
+    h.samples = f.numberOfSamples;
+    h.sourceSize = key.size;
+    h.sourceModified = key.modified;
+    std::memcpy(h.sourceHash,key.hash.constData(),std::min(sizeof(h.sourceHash),size_t(key.hash.size())));
+    h.pendingRows = s.pendingRows;
+    h.pendingEncoded = s.pendingEncoded ? 1 : 0;
+    std::copy(f.channelMin,f.channelMin+NUMBER_OF_CHANNELS,h.channelMin);
+    std::copy(f.channelMax,f.channelMax+NUMBER_OF_CHANNELS,h.channelMax);
+    std::copy(s.maxError,s.maxError+sampleStore::FLOATS_PER_SECTION,h.maxError);
+    std::copy(s.pendingError,s.pendingError+sampleStore::FLOATS_PER_SECTION,h.pendingError);
+    h.duration = r.duration;
+    h.cmDistance = r.cmDistance;
+    h.averageForwardSpeed = r.averageForwardSpeed;
+    h.peakForce = r.peakForce;
+    h.peakForceTime = r.peakForceTime;
+    h.peakForceSection = r.peakForceSection;
+    h.rangeBlockSize = channelRangeIndex::BLOCK_SIZE;
+    const char * data[NUMBER_OF_ARRAYS] =
+    {
+        reinterpret_cast<const char*>(f.position.data()),
+        reinterpret_cast<const char*>(f.mcposition.data()),
+        reinterpret_cast<const char*>(s.rows.data()),
+        reinterpret_cast<const char*>(s.packed.data()),
+        reinterpret_cast<const char*>(s.chunkOffset.data()),
+        reinterpret_cast<const char*>(s.chunkScale.data()),
+        reinterpret_cast<const char*>(s.pending.data()),
+        reinterpret_cast<const char*>(r.maxTorque.data()),
+        reinterpret_cast<const char*>(r.rmsTorque.data()),
+        reinterpret_cast<const char*>(rangeMinima.data()),
+        reinterpret_cast<const char*>(rangeMaxima.data())
+    };
+    const qint64 bytes[NUMBER_OF_ARRAYS] =
+    {
+        qint64(f.position.size()*sizeof(fileRecord)),
+        qint64(f.mcposition.size()*sizeof(snakeMCPos)),
+        qint64(s.rows.size()*sizeof(snakeSectionData)),
+        qint64(s.packed.size()*sizeof(quint16)),
+        qint64(s.chunkOffset.size()*sizeof(float)),
+        qint64(s.chunkScale.size()*sizeof(float)),
+        qint64(s.pending.size()*sizeof(float)),
+        qint64(r.maxTorque.size()*sizeof(float)),
+        qint64(r.rmsTorque.size()*sizeof(float)),
+        qint64(rangeMinima.size()*sizeof(float)),
+        qint64(rangeMaxima.size()*sizeof(float))
+    };
+    const qint64 counts[NUMBER_OF_ARRAYS] =
+    {
+        qint64(f.position.size()), qint64(f.mcposition.size()), qint64(s.rows.size()), qint64(s.packed.size()),
+        qint64(s.chunkOffset.size()), qint64(s.chunkScale.size()), qint64(s.pending.size()),
+        qint64(r.maxTorque.size()), qint64(r.rmsTorque.size()), qint64(rangeMinima.size()), qint64(rangeMaxima.size())
+    };
+    qint64 end = sizeof(h);
+    for(int a = 0; a < NUMBER_OF_ARRAYS; ++a)
+    {
+        h.offset[a] = alignUp(end);
+        h.count[a] = counts[a];
+        end = h.offset[a] + bytes[a];
+    }
+    // Written next to the cache and renamed over it, a reader never sees half a cache
+    QSaveFile out(getCacheFileName(key,s.storage));
+    if(!out.open(QIODevice::WriteOnly))
+    {
+        return false;
+    }
+    const char zeros[ARRAY_ALIGNMENT] = {};
+    bool ok = out.write(reinterpret_cast<const char*>(&h),sizeof(h)) == qint64(sizeof(h));
+    qint64 written = sizeof(h);
+    for(int a = 0; a < NUMBER_OF_ARRAYS && ok; ++a)
+    {
+        ok = out.write(zeros,h.offset[a]-written) == h.offset[a]-written &&
+             (bytes[a] == 0 || out.write(data[a],bytes[a]) == bytes[a]);
+        written = h.offset[a] + bytes[a];
+    }
+    if(!ok)
+    {
+        out.cancelWriting();
+        return false;
+    }
+    return out.commit();
+}
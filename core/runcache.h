@@ -0,0 +1,58 @@
+#ifndef RUNCACHE_H
+#define RUNCACHE_H
+
+#include <QString>
+#include <QFile>
+#include <QByteArray>
+#include "samplestore.h"
+
+class matlabFileInterface;
+struct runStatistics;
+
+// Directory the caches are kept in, runs/ in the cache location of the application unless
+// changed. An empty directory turns caching off.
+QString getRunCacheDirectory();
+void setRunCacheDirectory(const QString & directory);
+
+// Everything parsed and derived from a .datf on disk: the time index with the head poses, the
+// section rows in their storage, the centre of mass path, the channel ranges, the run statistics
+// and the block minima and maxima of the range index. A cache belongs
+// to a path and a storage and is only used while the size, modification time and a hash of spread
+// out blocks of the file are unchanged. It is mapped instead of read, the arrays of the interface
+// become views of the mapping, so opening a large run costs about as much as the hash.
+class runCache
+{
+public:
+    // Smaller files parse about as fast as their cache would load
+    enum { MIN_SOURCE_BYTES = 16 << 20 };
+
+    struct sourceKey
+    {
+        QString path;
+        qint64 size;
+        qint64 modified;        // Milliseconds since the epoch
+        QByteArray hash;
+    };
+
+    // Whether caching is on and the file is large enough for it
+    static bool isWanted(const QFile & source);
+    // Reads the key of an open file, moves its position
+    static sourceKey getKey(QFile & source);
+
+    // Fills f from its cache if there is a valid one, f must have read the header of its file
+    static bool load(const sourceKey & key, sampleStorage storage, matlabFileInterface & f);
+    // Writes the cache of f, replacing any old one at once. The statistics are computed if none
+    // are given, as are the leaves of the range index.
+    static bool save(const sourceKey & key, const matlabFileInterface & f, const runStatistics * statistics);
+
+    // The statistics and the range index leaves of the cache f was loaded from, false if f was
+    // parsed or has grown since. The leaves are the block minima and maxima of every channel and
+    // section in the order of the trees of channelRangeIndex, mapped from the cache.
+    static bool getStatistics(const matlabFileInterface & f, runStatistics & statistics);
+    static bool getRangeLeaves(const matlabFileInterface & f, const float *& minima, const float *& maxima);
+
+private:
+    static QString getCacheFileName(const sourceKey & key, sampleStorage storage);
+};
+
+#endif // RUNCACHE_H
@@ -0,0 +1,191 @@
+#ifndef RUNCOMPARISON_H
+#define RUNCOMPARISON_H
+
+#include <QString>
+#include <QtConcurrent/QtConcurrent>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include "matlabinterface.h"
+#include "kinematics.h"
+#include "simdkernels.h"
+
+// A reference run compared against the primary run. The reference is resampled onto the sample
+// times of the primary run once, when the two are aligned, so a frame only blends two aligned
+// reference samples with the same weight the primary run uses between its own samples.
+class runComparison
+{
+public:
+    runComparison() :
+        reference(nullptr),
+        primary(nullptr),
+        cursor(0),
+        maxPositionError(0.0f),
+        rmsPositionError(0.0f),
+        maxAngleError(0.0f),
+        meanAngleError(0.0f),
+        maxPositionSegment(-1),
+        maxAngleSegment(-1)
+    {
+    }
+
+    ~runComparison()
+    {
+        cacheSaving.waitForFinished();
+        delete reference;
+    }
+
+    // Returns false if the file has no samples. The cache of the reference is written on the
+    // thread pool.
+    bool load(const QString & fileName)
+    {
+        cacheSaving.waitForFinished();
+        delete reference;
+        reference = new matlabFileInterface(fileName);
+        cacheSaving = QtConcurrent::run(reference,&matlabFileInterface::saveCache,static_cast<const runStatistics*>(nullptr));
+        primary = nullptr;
+        alignment.clear();
+        this->fileName = fileName;
+        return reference->getNumberOfSamples() > 0 && reference->getNumberOfSections() > 0;
+    }
+
+    // Builds the alignment map, the reference interpolated at every sample time of the primary run.
+    // Times past the end of the reference hold its last sample.
+    void align(const matlabFileInterface * p)
+    {
+        primary = p;
+        cursor = 0;
+        alignment.resize(p->getNumberOfSamples());
+        quint32 referenceCursor = 0;
+        const float last = reference->get_lastTime();
+        for(int i = 0; i < p->getNumberOfSamples(); ++i)
+        {
+            alignment[i] = reference->locate(std::min(p->getSampleTime(i),last),referenceCursor);
+        }
+    }
+
+    bool isAligned() const
+    {
+        return primary && !alignment.empty();
+    }
+
+    // Samples the reference at time t of the primary run and compares it with the primary frame
+    void compare(float t, const snakeFrame & primaryFrame)
+    {
+        matlabFileInterface::interpolationParameters p = primary->locate(t,cursor);
+        reference->sampleFrame(alignment[p.i1],before);
+        reference->sampleFrame(alignment[p.i2],after);
+        frame.t = t;
+        frame.sample = -1;
+        frame.headX = before.headX + p.scale*(after.headX-before.headX);
+        frame.headY = before.headY + p.scale*(after.headY-before.headY);
+        frame.headAngle = before.headAngle + p.scale*(after.headAngle-before.headAngle);
+        frame.sections.resize(before.sections.size());
+        const float * a = reinterpret_cast<const float*>(before.sections.data());
+        const float * b = reinterpret_cast<const float*>(after.sections.data());
+        float * out = reinterpret_cast<float*>(frame.sections.data());
+        getSimdKernels().interpolate(a,b,p.scale,out,int(before.sections.size()*(sizeof(snakeSectionData)/sizeof(float))));
+        computeFramePoses(frame,poses);
+        computeErrors(primaryFrame.sections,frame.sections);
+    }
+
+    const std::vector<segmentPose> & getPoses() const
+    {
+        return poses;
+    }
+
+    const std::vector<float> & getPositionErrors() const
+    {
+        return positionError;
+    }
+
+    const std::vector<float> & getAngleErrors() const
+    {
+        return angleError;
+    }
+
+    const QString & getFileName() const
+    {
+        return fileName;
+    }
+
+    QString getSummary() const
+    {
+        return QString("Position error max %1 m (segment %2), RMS %3 m | Angle error max %4 deg (segment %5), mean %6 deg")
+                .arg(maxPositionError,0,'g',3).arg(maxPositionSegment).arg(rmsPositionError,0,'g',3)
+                .arg(maxAngleError*180.0f/3.1415927f,0,'g',3).arg(maxAngleSegment).arg(meanAngleError*180.0f/3.1415927f,0,'g',3);
+    }
+
+private:
+    // Segment wise differences, first split into flat arrays so every loop is a plain
+    // element-wise pass over floats
+    void computeErrors(const std::vector<snakeSectionData> & a, const std::vector<snakeSectionData> & b)
+    {
+        const int n = int(std::min(a.size(),b.size()));
+        dx.resize(n);
+        dy.resize(n);
+        dphi.resize(n);
+        positionError.resize(n);
+        angleError.resize(n);
+        for(int i = 0; i < n; ++i)
+        {
+            dx[i] = a[i].x - b[i].x;
+            dy[i] = a[i].y - b[i].y;
+            dphi[i] = a[i].phi - b[i].phi;
+        }
+        const float twoPi = 2.0f*3.1415927f;
+        for(int i = 0; i < n; ++i)
+        {
+            positionError[i] = std::sqrt(dx[i]*dx[i] + dy[i]*dy[i]);
+            // Wrapped into [-pi,pi) so a full turn isn't counted as an error
+            angleError[i] = std::abs(dphi[i] - twoPi*std::floor(dphi[i]/twoPi + 0.5f));
+        }
+        maxPositionError = 0.0f;
+        maxAngleError = 0.0f;
+        maxPositionSegment = -1;
+        maxAngleSegment = -1;
+        float sumSquares = 0.0f;
+        float sumAngles = 0.0f;
+        for(int i = 0; i < n; ++i)
+        {
+            sumSquares += positionError[i]*positionError[i];
+            sumAngles += angleError[i];
+            if(positionError[i] > maxPositionError || maxPositionSegment < 0)
+            {
+                maxPositionError = positionError[i];
+                maxPositionSegment = i;
+            }
+            if(angleError[i] > maxAngleError || maxAngleSegment < 0)
+            {
+                maxAngleError = angleError[i];
+                maxAngleSegment = i;
+            }
+        }
+        rmsPositionError = n > 0 ? std::sqrt(sumSquares/n) : 0.0f;
+        meanAngleError = n > 0 ? sumAngles/n : 0.0f;
+    }
+
+    QString fileName;
+    matlabFileInterface * reference;
+    QFuture<bool> cacheSaving;
+    const matlabFileInterface * primary;
+    std::vector<matlabFileInterface::interpolationParameters> alignment;
+    quint32 cursor;
+    snakeFrame before;
+    snakeFrame after;
+    snakeFrame frame;
+    std::vector<segmentPose> poses;
+    std::vector<float> dx;
+    std::vector<float> dy;
+    std::vector<float> dphi;
+    std::vector<float> positionError;
+    std::vector<float> angleError;
+    float maxPositionError;
+    float rmsPositionError;
+    float maxAngleError;
+    float meanAngleError;
+    int maxPositionSegment;
+    int maxAngleSegment;
+};
+
+#endif // RUNCOMPARISON_H
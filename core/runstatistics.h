@@ -0,0 +1,192 @@
+#ifndef RUNSTATISTICS_H
+#define RUNSTATISTICS_H
+
+#include <QString>
+#include <QThread>
+#include <QtConcurrent/QtConcurrent>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include "matlabinterface.h"
+
+// Summary numbers of a whole recorded run
+struct runStatistics
+{
+    std::vector<float> maxTorque;   // Largest absolute torque of every joint
+    std::vector<float> rmsTorque;
+    float duration;
+    float cmDistance;               // Length of the path of the centre of mass, meters
+    float averageForwardSpeed;      // Net displacement of the centre of mass over the duration
+    float peakForce;                // Largest resultant force on a single section
+    float peakForceTime;
+    int peakForceSection;
+
+    runStatistics() :
+        duration(0.0f),
+        cmDistance(0.0f),
+        averageForwardSpeed(0.0f),
+        peakForce(0.0f),
+        peakForceTime(0.0f),
+        peakForceSection(-1)
+    {
+    }
+
+    QString toText() const
+    {
+        QString s;
+        s += QString("Duration: %1 s\n").arg(duration);
+        s += QString("CM distance: %1 m\n").arg(cmDistance);
+        s += QString("Average forward speed: %1 m/s\n").arg(averageForwardSpeed);
+        s += QString("Peak resultant force: %1 N (section %2, t = %3 s)\n").arg(peakForce).arg(peakForceSection).arg(peakForceTime);
+        s += "\nJoint\tMax |torque|\tRMS torque\n";
+        for(unsigned int j = 0; j < maxTorque.size(); ++j)
+        {
+            s += QString("%1\t%2\t%3\n").arg(j).arg(maxTorque[j]).arg(rmsTorque[j]);
+        }
+        return s;
+    }
+
+    QString toCsv() const
+    {
+        QString s;
+        s += "quantity,index,value\n";
+        s += QString("duration,,%1\n").arg(duration);
+        s += QString("cm_distance,,%1\n").arg(cmDistance);
+        s += QString("average_forward_speed,,%1\n").arg(averageForwardSpeed);
+        s += QString("peak_force,%1,%2\n").arg(peakForceSection).arg(peakForce);
+        s += QString("peak_force_time,%1,%2\n").arg(peakForceSection).arg(peakForceTime);
+        for(unsigned int j = 0; j < maxTorque.size(); ++j)
+        {
+            s += QString("max_torque,%1,%2\n").arg(j).arg(maxTorque[j]);
+        }
+        for(unsigned int j = 0; j < rmsTorque.size(); ++j)
+        {
+            s += QString("rms_torque,%1,%2\n").arg(j).arg(rmsTorque[j]);
+        }
+        return s;
+    }
+};
+
+// The samples are split into blocks that are summarised in parallel, the partial results are then
+// combined in block order. Sums are kept in double so the result doesn't depend on the block count
+// in any visible digit. A run loaded from its cache has them stored, see runCache.
+class runStatisticsEngine
+{
+public:
+    static runStatistics compute(const matlabFileInterface * file)
+    {
+        runStatistics r;
+        if(runCache::getStatistics(*file,r))
+        {
+            return r;
+        }
+        const int numberOfSamples = file->getNumberOfSamples();
+        const int numberOfJoints = std::max(0,file->getNumberOfSections()-1);
+        if(numberOfSamples == 0)
+        {
+            return r;
+        }
+
+        const int numberOfBlocks = std::min(numberOfSamples,std::max(1,QThread::idealThreadCount()*4));
+        std::vector<block> blocks(numberOfBlocks);
+        for(int b = 0; b < numberOfBlocks; ++b)
+        {
+            blocks[b].file = file;
+            blocks[b].first = int((qint64(numberOfSamples)*b)/numberOfBlocks);
+            blocks[b].last = int((qint64(numberOfSamples)*(b+1))/numberOfBlocks);
+        }
+        QtConcurrent::blockingMap(blocks,summarise);
+
+        std::vector<double> sumSquares(numberOfJoints,0.0);
+        double distance = 0.0;
+        r.maxTorque.assign(numberOfJoints,0.0f);
+        for(int b = 0; b < numberOfBlocks; ++b)
+        {
+            const block & k = blocks[b];
+            for(int j = 0; j < numberOfJoints; ++j)
+            {
+                r.maxTorque[j] = std::max(r.maxTorque[j],k.maxTorque[j]);
+                sumSquares[j] += k.sumSquares[j];
+            }
+            distance += k.distance;
+            if(k.peakForce > r.peakForce || r.peakForceSection < 0)
+            {
+                r.peakForce = k.peakForce;
+                r.peakForceTime = k.peakForceTime;
+                r.peakForceSection = k.peakForceSection;
+            }
+        }
+        r.rmsTorque.resize(numberOfJoints);
+        for(int j = 0; j < numberOfJoints; ++j)
+        {
+            r.rmsTorque[j] = float(std::sqrt(sumSquares[j]/numberOfSamples));
+        }
+        r.cmDistance = float(distance);
+        r.duration = file->get_lastTime() - file->getSampleTime(0);
+        snakeMCPos begin = file->getMCPosition(0);
+        snakeMCPos end = file->getMCPosition(numberOfSamples-1);
+        if(r.duration > 0.0f)
+        {
+            r.averageForwardSpeed = std::sqrt((end.x-begin.x)*(end.x-begin.x)+(end.y-begin.y)*(end.y-begin.y))/r.duration;
+        }
+        return r;
+    }
+
+private:
+    struct block
+    {
+        const matlabFileInterface * file;
+        int first;
+        int last;
+        std::vector<float> maxTorque;
+        std::vector<double> sumSquares;
+        double distance;
+        float peakForce;
+        float peakForceTime;
+        int peakForceSection;
+    };
+
+    static void summarise(block & k)
+    {
+        traceScope trace("statistics block");
+        const matlabFileInterface * file = k.file;
+        const int n = file->getNumberOfSections();
+        const int numberOfJoints = std::max(0,n-1);
+        k.maxTorque.assign(numberOfJoints,0.0f);
+        k.sumSquares.assign(numberOfJoints,0.0);
+        k.distance = 0.0;
+        k.peakForce = 0.0f;
+        k.peakForceTime = 0.0f;
+        k.peakForceSection = -1;
+        std::vector<snakeSectionData> buffer;
+        for(int i = k.first; i < k.last; ++i)
+        {
+            const snakeSectionData * s = file->getSampleSections(i,buffer);
+            for(int j = 0; j < numberOfJoints; ++j)
+            {
+                const float torque = s[j].torque;
+                k.maxTorque[j] = std::max(k.maxTorque[j],std::abs(torque));
+                k.sumSquares[j] += double(torque)*torque;
+            }
+            for(int j = 0; j < n; ++j)
+            {
+                const float f = channelValue(s[j],CHANNEL_FORCE_MAGNITUDE);
+                if(f > k.peakForce || k.peakForceSection < 0)
+                {
+                    k.peakForce = f;
+                    k.peakForceTime = file->getSampleTime(i);
+                    k.peakForceSection = j;
+                }
+            }
+            // The step into the first sample of the block is counted by this block
+            if(i > 0)
+            {
+                snakeMCPos a = file->getMCPosition(i-1);
+                snakeMCPos b = file->getMCPosition(i);
+                k.distance += std::sqrt(double(b.x-a.x)*(b.x-a.x)+double(b.y-a.y)*(b.y-a.y));
+            }
+        }
+    }
+};
+
+#endif // RUNSTATISTICS_H
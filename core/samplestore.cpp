@@ -0,0 +1,283 @@
+#include "samplestore.h"
+#include "simdkernels.h"
+#include <QStringList>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+static std::atomic<int> & defaultStorage()
+{
+    static std::atomic<int> storage(STORAGE_FLOAT32);
+    return storage;
+}
+
+sampleStorage getDefaultStorage()
+{
+    return sampleStorage(defaultStorage().load(std::memory_order_relaxed));
+}
+
+void setDefaultStorage(sampleStorage storage)
+{
+    defaultStorage().store(storage,std::memory_order_relaxed);
+}
+
+const char * getStorageName(sampleStorage storage)
+{
+    switch(storage)
+    {
+    case STORAGE_FLOAT32:
+        return "float32";
+    case STORAGE_FLOAT16:
+        return "float16";
+    case STORAGE_INT16:
+        return "int16";
+    default:
+        return "unknown";
+    }
+}
+
+bool parseStorage(const QString & name, sampleStorage & storage)
+{
+    for(int s = 0; s < NUMBER_OF_STORAGES; ++s)
+    {
+        if(name == getStorageName(sampleStorage(s)))
+        {
+            storage = sampleStorage(s);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Round to nearest even, values beyond the half range become infinite
+static quint16 floatToHalf(float f)
+{
+    const quint32 infinity = 255u << 23;
+    const quint32 halfMax = (127u + 16u) << 23;
+    const quint32 denormMagic = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+    quint32 u;
+    std::memcpy(&u,&f,4);
+    const quint32 sign = u & 0x80000000u;
+    u ^= sign;
+    quint32 h;
+    if(u >= halfMax)
+    {
+        h = u > infinity ? 0x7e00 : 0x7c00;
+    }
+    else if(u < (113u << 23))
+    {
+        // Adding the magic number lines the 10 mantissa bits of a denormal up at the bottom
+        float a;
+        float magic;
+        std::memcpy(&a,&u,4);
+        std::memcpy(&magic,&denormMagic,4);
+        a += magic;
+        std::memcpy(&u,&a,4);
+        h = u - denormMagic;
+    }
+    else
+    {
+        const quint32 odd = (u >> 13) & 1;
+        u += ((15u - 127u) << 23) + 0xfff + odd;
+        h = u >> 13;
+    }
+    return quint16(h | (sign >> 16));
+}
+
+sampleStore::sampleStore() :
+    storage(STORAGE_FLOAT32),
+    sections(0),
+    rowFloats(0),
+    samples(0),
+    pendingRows(0),
+    pendingEncoded(false)
+{
+    std::fill(maxError,maxError+FLOATS_PER_SECTION,0.0f);
+    std::fill(pendingError,pendingError+FLOATS_PER_SECTION,0.0f);
+}
+
+void sampleStore::reset(sampleStorage storage, int sections)
+{
+    this->storage = storage;
+    this->sections = sections;
+    rowFloats = sections*FLOATS_PER_SECTION;
+    samples = 0;
+    rows.clear();
+    packed.clear();
+    chunkOffset.clear();
+    chunkScale.clear();
+    pending.clear();
+    pendingRows = 0;
+    pendingEncoded = false;
+    std::fill(maxError,maxError+FLOATS_PER_SECTION,0.0f);
+    std::fill(pendingError,pendingError+FLOATS_PER_SECTION,0.0f);
+}
+
+void sampleStore::append(const snakeSectionData * row)
+{
+    ++samples;
+    if(storage == STORAGE_FLOAT32)
+    {
+        rows.append(row,row+sections);
+        return;
+    }
+    if(pendingEncoded)
+    {
+        // The partial chunk of the last finish gets more rows, it is encoded again once it is full
+        packed.resize(packed.size() - size_t(pendingRows)*rowFloats);
+        chunkOffset.resize(chunkOffset.size() - rowFloats);
+        chunkScale.resize(chunkScale.size() - rowFloats);
+        std::fill(pendingError,pendingError+FLOATS_PER_SECTION,0.0f);
+        pendingEncoded = false;
+    }
+    const float * values = reinterpret_cast<const float*>(row);
+    pending.insert(pending.end(),values,values+rowFloats);
+    ++pendingRows;
+    if(storage == STORAGE_FLOAT16 || pendingRows == CHUNK_SAMPLES)
+    {
+        encodeChunk(pending.data(),pendingRows,maxError);
+        pending.clear();
+        pendingRows = 0;
+    }
+}
+
+void sampleStore::finish()
+{
+    if(pendingRows > 0 && !pendingEncoded)
+    {
+        // The rows are kept as well, so appending can continue the chunk
+        encodeChunk(pending.data(),pendingRows,pendingError);
+        pendingEncoded = true;
+    }
+    pending.shrink_to_fit();
+}
+
+void sampleStore::encodeChunk(const float * values, int count, float * error)
+{
+    const size_t first = packed.size();
+    packed.resize(first + size_t(count)*rowFloats);
+    quint16 * out = packed.mutableData() + first;
+    std::vector<float> decoded(rowFloats);
+    if(storage == STORAGE_FLOAT16)
+    {
+        for(int i = 0; i < count*rowFloats; ++i)
+        {
+            out[i] = floatToHalf(values[i]);
+        }
+        for(int r = 0; r < count; ++r)
+        {
+            getSimdKernels().decodeHalf(out + r*rowFloats,decoded.data(),rowFloats);
+            for(int i = 0; i < rowFloats; ++i)
+            {
+                float & e = error[i % FLOATS_PER_SECTION];
+                e = std::max(e,std::abs(decoded[i]-values[r*rowFloats+i]));
+            }
+        }
+        return;
+    }
+    // Every value gets the 65535 steps between its minimum and maximum over the chunk, centred
+    // on zero so the steps fit a signed 16 bit integer
+    const size_t chunk = chunkOffset.size();
+    chunkOffset.resize(chunk + rowFloats);
+    chunkScale.resize(chunk + rowFloats);
+    float * offset = chunkOffset.mutableData() + chunk;
+    float * scale = chunkScale.mutableData() + chunk;
+    for(int i = 0; i < rowFloats; ++i)
+    {
+        float lo = values[i];
+        float hi = values[i];
+        for(int r = 1; r < count; ++r)
+        {
+            lo = std::min(lo,values[r*rowFloats+i]);
+            hi = std::max(hi,values[r*rowFloats+i]);
+        }
+        offset[i] = 0.5f*(lo+hi);
+        scale[i] = (hi-lo)/65534.0f;
+    }
+    qint16 * q = reinterpret_cast<qint16*>(out);
+    for(int r = 0; r < count; ++r)
+    {
+        for(int i = 0; i < rowFloats; ++i)
+        {
+            const float v = scale[i] > 0.0f ? (values[r*rowFloats+i]-offset[i])/scale[i] : 0.0f;
+            q[r*rowFloats+i] = qint16(std::max(-32767.0f,std::min(32767.0f,std::round(v))));
+        }
+        getSimdKernels().decodeScaled(q + r*rowFloats,offset,scale,decoded.data(),rowFloats);
+        for(int i = 0; i < rowFloats; ++i)
+        {
+            float & e = error[i % FLOATS_PER_SECTION];
+            e = std::max(e,std::abs(decoded[i]-values[r*rowFloats+i]));
+        }
+    }
+}
+
+const snakeSectionData * sampleStore::getRow(int sample, snakeSectionData * buffer) const
+{
+    const size_t first = size_t(sample)*rowFloats;
+    float * out = reinterpret_cast<float*>(buffer);
+    switch(storage)
+    {
+    case STORAGE_FLOAT16:
+        getSimdKernels().decodeHalf(&packed[first],out,rowFloats);
+        return buffer;
+    case STORAGE_INT16:
+    {
+        const size_t chunk = size_t(sample/CHUNK_SAMPLES)*rowFloats;
+        getSimdKernels().decodeScaled(reinterpret_cast<const qint16*>(&packed[first]),&chunkOffset[chunk],&chunkScale[chunk],out,rowFloats);
+        return buffer;
+    }
+    default:
+        return &rows[size_t(sample)*sections];
+    }
+}
+
+snakeSectionData sampleStore::getSection(int sample, int section) const
+{
+    if(storage == STORAGE_FLOAT32)
+    {
+        return rows[size_t(sample)*sections + section];
+    }
+    snakeSectionData d;
+    const size_t first = size_t(sample)*rowFloats + size_t(section)*FLOATS_PER_SECTION;
+    float * out = reinterpret_cast<float*>(&d);
+    if(storage == STORAGE_FLOAT16)
+    {
+        getSimdKernels().decodeHalf(&packed[first],out,FLOATS_PER_SECTION);
+    }
+    else
+    {
+        const size_t chunk = size_t(sample/CHUNK_SAMPLES)*rowFloats + size_t(section)*FLOATS_PER_SECTION;
+        getSimdKernels().decodeScaled(reinterpret_cast<const qint16*>(&packed[first]),&chunkOffset[chunk],&chunkScale[chunk],out,FLOATS_PER_SECTION);
+    }
+    return d;
+}
+
+qint64 sampleStore::getBytes() const
+{
+    return qint64(rows.size()*sizeof(snakeSectionData) + packed.size()*sizeof(quint16) +
+                  (chunkOffset.size()+chunkScale.size())*sizeof(float));
+}
+
+QString sampleStore::getSummary() const
+{
+    static const char * const fields[FLOATS_PER_SECTION] =
+    {
+        "x", "y", "phi", "dx", "dy", "d_phi", "f_res_x", "f_res_y", "torque"
+    };
+    const qint64 full = qint64(samples)*sections*qint64(sizeof(snakeSectionData));
+    QString text = QString("Sample storage %1, %2 MB (%3% of float32)")
+            .arg(getStorageName(storage))
+            .arg(double(getBytes())/(1 << 20),0,'f',1)
+            .arg(full > 0 ? 100.0*double(getBytes())/double(full) : 100.0,0,'f',0);
+    if(storage != STORAGE_FLOAT32)
+    {
+        QStringList errors;
+        for(int i = 0; i < FLOATS_PER_SECTION; ++i)
+        {
+            errors << QString("%1 %2").arg(fields[i]).arg(double(getMaxError(i)),0,'g',3);
+        }
+        text += "\nLargest error: " + errors.join(", ");
+    }
+    return text;
+}
@@ -0,0 +1,198 @@
+#ifndef SAMPLESTORE_H
+#define SAMPLESTORE_H
+
+#include <QString>
+#include <vector>
+#include <algorithm>
+
+struct snakeSectionData
+{
+    float x;
+    float y;
+    float phi;
+    float dx;
+    float dy;
+    float d_phi;
+    float f_res_x;
+    float f_res_y;
+    float torque;
+};
+
+// Array that is either owned, or a view of memory owned elsewhere, e.g. a mapped cache file.
+// Changing a view copies it into an owned array first.
+template <class T>
+class sampleArray
+{
+public:
+    sampleArray() :
+        view(nullptr),
+        viewSize(0)
+    {
+    }
+
+    size_t size() const
+    {
+        return view ? viewSize : owned.size();
+    }
+    bool empty() const
+    {
+        return size() == 0;
+    }
+    const T * data() const
+    {
+        return view ? view : owned.data();
+    }
+    const T * begin() const
+    {
+        return data();
+    }
+    const T * end() const
+    {
+        return data() + size();
+    }
+    const T & operator[](size_t i) const
+    {
+        return data()[i];
+    }
+
+    T * mutableData()
+    {
+        own();
+        return owned.data();
+    }
+    void push_back(const T & v)
+    {
+        own();
+        owned.push_back(v);
+    }
+    void append(const T * first, const T * last)
+    {
+        own();
+        owned.insert(owned.end(),first,last);
+    }
+    void resize(size_t n)
+    {
+        own();
+        owned.resize(n);
+    }
+    void reserve(size_t n)
+    {
+        own();
+        owned.reserve(n);
+    }
+    void clear()
+    {
+        view = nullptr;
+        viewSize = 0;
+        owned.clear();
+    }
+    void shrink_to_fit()
+    {
+        owned.shrink_to_fit();
+    }
+
+    // Uses n elements at p instead of an own copy, p must outlive the array or the next change
+    void setView(const T * p, size_t n)
+    {
+        std::vector<T>().swap(owned);
+        view = p;
+        viewSize = n;
+    }
+
+private:
+    void own()
+    {
+        if(view)
+        {
+            owned.assign(view,view+viewSize);
+            view = nullptr;
+            viewSize = 0;
+        }
+    }
+
+    std::vector<T> owned;
+    const T * view;
+    size_t viewSize;
+};
+
+// How the section data of a file is kept in memory
+enum sampleStorage
+{
+    STORAGE_FLOAT32,        // As in the file, 36 bytes per section and sample
+    STORAGE_FLOAT16,        // IEEE half precision, 18 bytes
+    STORAGE_INT16,          // 16 bit steps between the minimum and maximum of each value over a chunk, 18 bytes
+    NUMBER_OF_STORAGES
+};
+
+const char * getStorageName(sampleStorage storage);
+
+// Parses float32, float16 or int16, returns false for anything else
+bool parseStorage(const QString & name, sampleStorage & storage);
+
+// Storage of files opened without asking for one, float32 unless changed
+sampleStorage getDefaultStorage();
+void setDefaultStorage(sampleStorage storage);
+
+// The section data of all samples of a run, one row of N sections per sample. Rows are appended
+// while parsing and are immutable afterwards, so any number of threads can read them. More rows
+// can be appended after finish, without readers. In the compact storages a row is decoded into a
+// buffer of the caller by the SIMD kernels. The arrays can also be views of a mapped cache, see
+// runCache.
+class sampleStore
+{
+public:
+    // Rows per chunk of the int16 storage, every value has its own range in every chunk
+    enum { CHUNK_SAMPLES = 256 };
+    enum { FLOATS_PER_SECTION = 9 };
+
+    sampleStore();
+
+    void reset(sampleStorage storage, int sections);
+    void append(const snakeSectionData * row);
+    // Encodes the rows still waiting for a full chunk, call after the last append of a batch
+    void finish();
+
+    // The row of a sample, either stored as it is or decoded into buffer, which must hold N sections
+    const snakeSectionData * getRow(int sample, snakeSectionData * buffer) const;
+    snakeSectionData getSection(int sample, int section) const;
+
+    sampleStorage getStorage() const
+    {
+        return storage;
+    }
+    int getNumberOfSamples() const
+    {
+        return samples;
+    }
+    // Bytes held by the section data, including the ranges of the int16 chunks
+    qint64 getBytes() const;
+    // Largest difference between a stored and a file value of a field of snakeSectionData, in
+    // field order x, y, phi, dx, dy, d_phi, f_res_x, f_res_y, torque
+    float getMaxError(int field) const
+    {
+        return std::max(maxError[field],pendingError[field]);
+    }
+    // Storage, memory and error bounds as text
+    QString getSummary() const;
+
+private:
+    friend class runCache;
+
+    void encodeChunk(const float * rows, int count, float * error);
+
+    sampleStorage storage;
+    int sections;
+    int rowFloats;
+    int samples;
+    sampleArray<snakeSectionData> rows;     // STORAGE_FLOAT32
+    sampleArray<quint16> packed;            // STORAGE_FLOAT16 and STORAGE_INT16
+    sampleArray<float> chunkOffset;         // STORAGE_INT16, rowFloats per chunk
+    sampleArray<float> chunkScale;
+    std::vector<float> pending;             // Rows of the chunk being filled
+    int pendingRows;
+    bool pendingEncoded;                    // The pending rows are also encoded, by finish
+    float maxError[FLOATS_PER_SECTION];     // Of the full chunks
+    float pendingError[FLOATS_PER_SECTION];
+};
+
+#endif // SAMPLESTORE_H
@@ -0,0 +1,165 @@
+#ifndef SEGMENTHASH_H
+#define SEGMENTHASH_H
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <QtGlobal>
+#include "kinematics.h"
+#include "dimensions.h"
+
+// Finds the segment under a point in scene units. The segments of a frame are bucketed into a
+// uniform grid of cells just wider than a segment, hashed into a table of about twice as many buckets as
+// segments, so a lookup tests the few segments of one bucket. Building is a counting sort into
+// arrays that are reused from frame to frame.
+class segmentHash
+{
+public:
+    segmentHash() :
+        poses(nullptr),
+        cellSize(1.0f),
+        mask(0)
+    {
+    }
+
+    // The poses are kept by reference and must stay unchanged until the next build
+    void build(const std::vector<segmentPose> & p)
+    {
+        poses = &p;
+        const int n = int(p.size());
+        // A segment fits inside a cell with room to spare for rounding, so it overlaps at most
+        // four of them
+        const float radiiPerCell = 2.02f;
+        cellSize = radiiPerCell*getRadius(0);
+        for(int i = 1; i < n; ++i)
+        {
+            cellSize = std::max(cellSize,radiiPerCell*getRadius(i));
+        }
+        size_t buckets = 1;
+        while(buckets < size_t(2*n))
+        {
+            buckets *= 2;
+        }
+        mask = buckets-1;
+        bucketStart.assign(buckets+1,0);
+        cells.resize(size_t(4*n));
+        cellCount.resize(size_t(n));
+        for(int i = 0; i < n; ++i)
+        {
+            cellCount[i] = getCells(i,&cells[size_t(4*i)]);
+            for(int c = 0; c < cellCount[i]; ++c)
+            {
+                ++bucketStart[cells[size_t(4*i+c)]+1];
+            }
+        }
+        for(size_t b = 0; b < buckets; ++b)
+        {
+            bucketStart[b+1] += bucketStart[b];
+        }
+        fill.assign(bucketStart.begin(),bucketStart.end()-1);
+        entries.resize(bucketStart[buckets]);
+        for(int i = 0; i < n; ++i)
+        {
+            for(int c = 0; c < cellCount[i]; ++c)
+            {
+                entries[fill[cells[size_t(4*i+c)]]++] = i;
+            }
+        }
+    }
+
+    // Index of the segment whose body contains the point, the one with the closest centre if
+    // bodies overlap, or -1
+    int find(float x, float y) const
+    {
+        if(!poses || poses->empty())
+        {
+            return -1;
+        }
+        const size_t b = bucket(cellOf(x),cellOf(y));
+        int best = -1;
+        float bestDistance = 0.0f;
+        for(unsigned int e = bucketStart[b]; e < bucketStart[b+1]; ++e)
+        {
+            const int i = entries[e];
+            const segmentPose & p = (*poses)[i];
+            const float dx = x-p.x;
+            const float dy = y-p.y;
+            const float d = dx*dx + dy*dy;
+            if((best < 0 || d < bestDistance) && contains(i,dx,dy))
+            {
+                best = i;
+                bestDistance = d;
+            }
+        }
+        return best;
+    }
+
+private:
+    static float getRadius(int i)
+    {
+        typedef robot_dimensions<SCALE_ALL_FACTOR> RD;
+        const float along = std::max(RD::segmentMCtoEdgeForward(i),RD::segmentMCtoEdgeBackward(i));
+        const float across = std::max(RD::segmentMCtoEdgeLeft(i),RD::segmentMCtoEdgeRight(i));
+        return std::sqrt(along*along + across*across);
+    }
+
+    int cellOf(float v) const
+    {
+        return int(std::floor(v/cellSize));
+    }
+
+    size_t bucket(int cx, int cy) const
+    {
+        return (size_t(unsigned(cx)*73856093u) ^ size_t(unsigned(cy)*19349663u)) & mask;
+    }
+
+    // Distinct buckets of the cells the bounding circle of a segment overlaps
+    int getCells(int i, unsigned int * out) const
+    {
+        const segmentPose & p = (*poses)[i];
+        const float r = getRadius(i);
+        // Never more than two cells per axis, the slots of a segment hold four buckets
+        const int x0 = cellOf(p.x-r);
+        const int x1 = std::min(cellOf(p.x+r),x0+1);
+        const int y0 = cellOf(p.y-r);
+        const int y1 = std::min(cellOf(p.y+r),y0+1);
+        int count = 0;
+        for(int cx = x0; cx <= x1; ++cx)
+        {
+            for(int cy = y0; cy <= y1; ++cy)
+            {
+                const unsigned int b = unsigned(bucket(cx,cy));
+                if(std::find(out,out+count,b) == out+count)
+                {
+                    out[count++] = b;
+                }
+            }
+        }
+        Q_ASSERT(count <= 4);
+        return count;
+    }
+
+    // Whether the offset from the centre of mass lies on the body, in the frame of the segment
+    bool contains(int i, float dx, float dy) const
+    {
+        typedef robot_dimensions<SCALE_ALL_FACTOR> RD;
+        const float rot = (*poses)[i].rot;
+        const float c = std::cos(rot);
+        const float s = std::sin(rot);
+        const float along = c*dx + s*dy;
+        const float across = -s*dx + c*dy;
+        return along >= -RD::segmentMCtoEdgeBackward(i) && along <= RD::segmentMCtoEdgeForward(i) &&
+               across >= -RD::segmentMCtoEdgeLeft(i) && across <= RD::segmentMCtoEdgeRight(i);
+    }
+
+    const std::vector<segmentPose> * poses;
+    float cellSize;
+    size_t mask;
+    std::vector<unsigned int> bucketStart;  // Entries of bucket b are [bucketStart[b], bucketStart[b+1])
+    std::vector<unsigned int> fill;
+    std::vector<int> entries;
+    std::vector<unsigned int> cells;        // Up to four buckets per segment
+    std::vector<int> cellCount;
+};
+
+#endif // SEGMENTHASH_H
@@ -0,0 +1,253 @@
+#include "simdkernels.h"
+#include <QByteArray>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+#define SNAKE_SIMD_X86
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+#ifdef SNAKE_SIMD_X86
+// Defined in simdkernels_x86.cpp
+extern const simdKernels sse42Kernels;
+extern const simdKernels avx2Kernels;
+extern const simdKernels avx512Kernels;
+#endif
+
+static void interpolateScalar(const float * a, const float * b, float scale, float * out, int n)
+{
+    for(int i = 0; i < n; ++i)
+    {
+        out[i] = a[i] + scale*(b[i]-a[i]);
+    }
+}
+
+static void prefixSumScalar(const float * in, float start, float * out, int n)
+{
+    float sum = start;
+    for(int i = 0; i < n; ++i)
+    {
+        sum += in[i];
+        out[i] = sum;
+    }
+}
+
+static void sinCosScalar(const float * x, float * s, float * c, int n)
+{
+    for(int i = 0; i < n; ++i)
+    {
+        s[i] = std::sin(x[i]);
+        c[i] = std::cos(x[i]);
+    }
+}
+
+static void arrowMagnitudesScalar(const float * x, const float * y, float * len, float * dirX, float * dirY, int n)
+{
+    for(int i = 0; i < n; ++i)
+    {
+        len[i] = std::sqrt(x[i]*x[i] + y[i]*y[i]);
+        const float inv = len[i] > 0.0f ? 1.0f/len[i] : 0.0f;
+        dirX[i] = x[i]*inv;
+        dirY[i] = y[i]*inv;
+    }
+}
+
+// The exponent is moved into place by a multiplication, infinities and NaNs get theirs back after
+static void decodeHalfScalar(const quint16 * in, float * out, int n)
+{
+    const quint32 magicBits = (254u - 15u) << 23;
+    const quint32 infNanBits = (127u + 16u) << 23;
+    float magic;
+    float infNan;
+    std::memcpy(&magic,&magicBits,4);
+    std::memcpy(&infNan,&infNanBits,4);
+    for(int i = 0; i < n; ++i)
+    {
+        quint32 u = quint32(in[i] & 0x7fff) << 13;
+        float f;
+        std::memcpy(&f,&u,4);
+        f *= magic;
+        std::memcpy(&u,&f,4);
+        if(f >= infNan)
+        {
+            u |= 255u << 23;
+        }
+        u |= quint32(in[i] & 0x8000) << 16;
+        std::memcpy(&out[i],&u,4);
+    }
+}
+
+static void decodeScaledScalar(const qint16 * in, const float * offset, const float * scale, float * out, int n)
+{
+    for(int i = 0; i < n; ++i)
+    {
+        out[i] = offset[i] + scale[i]*float(in[i]);
+    }
+}
+
+static const simdKernels scalarKernels =
+{
+    SIMD_SCALAR,
+    interpolateScalar,
+    prefixSumScalar,
+    sinCosScalar,
+    arrowMagnitudesScalar,
+    decodeHalfScalar,
+    decodeScaledScalar
+};
+
+static const simdKernels * getKernels(simdLevel level)
+{
+    switch(level)
+    {
+#ifdef SNAKE_SIMD_X86
+    case SIMD_SSE42:
+        return &sse42Kernels;
+    case SIMD_AVX2:
+        return &avx2Kernels;
+    case SIMD_AVX512:
+        return &avx512Kernels;
+#endif
+    default:
+        return &scalarKernels;
+    }
+}
+
+#if defined(SNAKE_SIMD_X86) && defined(_MSC_VER)
+// The OS must save the upper registers too, checked through XCR0
+static bool isSupported(simdLevel level)
+{
+    int r[4];
+    __cpuid(r,0);
+    const int maxLeaf = r[0];
+    __cpuid(r,1);
+    const bool sse42 = (r[2] & (1 << 20)) != 0;
+    const bool osxsave = (r[2] & (1 << 27)) != 0;
+    const unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+    int ebx7 = 0;
+    if(maxLeaf >= 7)
+    {
+        __cpuidex(r,7,0);
+        ebx7 = r[1];
+    }
+    switch(level)
+    {
+    case SIMD_SCALAR:
+        return true;
+    case SIMD_SSE42:
+        return sse42;
+    case SIMD_AVX2:
+        return (xcr0 & 0x6) == 0x6 && (ebx7 & (1 << 5)) != 0;
+    case SIMD_AVX512:
+        return (xcr0 & 0xe6) == 0xe6 && (ebx7 & (1 << 16)) != 0 && (ebx7 & (1 << 5)) != 0;
+    default:
+        return false;
+    }
+}
+#elif defined(SNAKE_SIMD_X86)
+static bool isSupported(simdLevel level)
+{
+    __builtin_cpu_init();
+    switch(level)
+    {
+    case SIMD_SCALAR:
+        return true;
+    case SIMD_SSE42:
+        return __builtin_cpu_supports("sse4.2");
+    case SIMD_AVX2:
+        return __builtin_cpu_supports("avx2");
+    case SIMD_AVX512:
+        return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx2");
+    default:
+        return false;
+    }
+}
+#else
+static bool isSupported(simdLevel level)
+{
+    return level == SIMD_SCALAR;
+}
+#endif
+
+static std::atomic<const simdKernels*> & currentKernels()
+{
+    static std::atomic<const simdKernels*> current(nullptr);
+    return current;
+}
+
+simdLevel getSupportedSimdLevel()
+{
+    static const simdLevel supported = []()
+    {
+        int level = NUMBER_OF_SIMD_LEVELS-1;
+        while(level > SIMD_SCALAR && !isSupported(simdLevel(level)))
+        {
+            --level;
+        }
+        return simdLevel(level);
+    }();
+    return supported;
+}
+
+const simdKernels & getSimdKernels()
+{
+    const simdKernels * k = currentKernels().load(std::memory_order_acquire);
+    if(k)
+    {
+        return *k;
+    }
+    simdLevel level = getSupportedSimdLevel();
+    simdLevel forced;
+    if(parseSimdLevel(QString::fromLocal8Bit(qgetenv("SNAKE_SIMD")),forced) && forced <= level)
+    {
+        level = forced;
+    }
+    k = getKernels(level);
+    // Threads racing here all pick the same kernels
+    currentKernels().store(k,std::memory_order_release);
+    return *k;
+}
+
+bool setSimdLevel(simdLevel level)
+{
+    if(level >= NUMBER_OF_SIMD_LEVELS || level > getSupportedSimdLevel())
+    {
+        return false;
+    }
+    currentKernels().store(getKernels(level),std::memory_order_release);
+    return true;
+}
+
+const char * getSimdLevelName(simdLevel level)
+{
+    switch(level)
+    {
+    case SIMD_SCALAR:
+        return "scalar";
+    case SIMD_SSE42:
+        return "sse4.2";
+    case SIMD_AVX2:
+        return "avx2";
+    case SIMD_AVX512:
+        return "avx512";
+    default:
+        return "unknown";
+    }
+}
+
+bool parseSimdLevel(const QString & name, simdLevel & level)
+{
+    for(int l = 0; l < NUMBER_OF_SIMD_LEVELS; ++l)
+    {
+        if(name == getSimdLevelName(simdLevel(l)))
+        {
+            level = simdLevel(l);
+            return true;
+        }
+    }
+    return false;
+}
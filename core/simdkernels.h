@@ -0,0 +1,50 @@
+#ifndef SIMDKERNELS_H
+#define SIMDKERNELS_H
+
+#include <QString>
+
+// Instruction sets the numeric kernels are compiled for, in increasing order
+enum simdLevel
+{
+    SIMD_SCALAR,
+    SIMD_SSE42,
+    SIMD_AVX2,
+    SIMD_AVX512,
+    NUMBER_OF_SIMD_LEVELS
+};
+
+// The hot loops of frame sampling, sample decoding, kinematics and the arrow overlays. Arrays may
+// have any length and alignment.
+struct simdKernels
+{
+    simdLevel level;
+    // out[i] = a[i] + scale*(b[i]-a[i])
+    void (*interpolate)(const float * a, const float * b, float scale, float * out, int n);
+    // out[i] = start + in[0] + ... + in[i], out may be in
+    void (*prefixSum)(const float * in, float start, float * out, int n);
+    void (*sinCos)(const float * x, float * s, float * c, int n);
+    // Length and unit direction of every vector, the direction of a zero vector is zero
+    void (*arrowMagnitudes)(const float * x, const float * y, float * len, float * dirX, float * dirY, int n);
+    // IEEE half precision to float
+    void (*decodeHalf)(const quint16 * in, float * out, int n);
+    // out[i] = offset[i] + scale[i]*in[i]
+    void (*decodeScaled)(const qint16 * in, const float * offset, const float * scale, float * out, int n);
+};
+
+// The kernels in use. The first call picks the best level this CPU supports, or the level named
+// by the environment variable SNAKE_SIMD if it is supported.
+const simdKernels & getSimdKernels();
+
+// Highest level both this build and this CPU support
+simdLevel getSupportedSimdLevel();
+
+// Switches all kernels to a level, e.g. to compare them in benchmarks. Returns false and keeps the
+// current kernels if the level is not supported.
+bool setSimdLevel(simdLevel level);
+
+const char * getSimdLevelName(simdLevel level);
+
+// Parses scalar, sse4.2, avx2 or avx512, returns false for anything else
+bool parseSimdLevel(const QString & name, simdLevel & level);
+
+#endif // SIMDKERNELS_H
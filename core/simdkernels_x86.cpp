@@ -0,0 +1,520 @@
+#include "simdkernels.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+
+#include <immintrin.h>
+#include <cmath>
+#include <cstring>
+
+// Every function carries the instruction set it is written for, so the rest of the library keeps
+// the baseline flags and the variants are only called after getSimdKernels checked the CPU.
+#if defined(__GNUC__)
+#define TARGET_SSE42 __attribute__((target("sse4.2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_AVX512 __attribute__((target("avx512f,avx2")))
+#else
+#define TARGET_SSE42
+#define TARGET_AVX2
+#define TARGET_AVX512
+#endif
+
+// Half to float by moving the exponent into place with a multiplication, infinities and NaNs get
+// theirs back after
+static const quint32 HALF_MAGIC = (254u - 15u) << 23;
+static const quint32 HALF_INF_NAN = (127u + 16u) << 23;
+
+// Cephes single precision sin and cos: reduction by pi/4 in three parts and a polynomial on
+// [-pi/4,pi/4], about 1e-7 absolute error for the angles a snake body reaches
+static const float FOUR_OVER_PI = 1.27323954473516f;
+static const float DP1 = -0.78515625f;
+static const float DP2 = -2.4187564849853515625e-4f;
+static const float DP3 = -3.77489497744594108e-8f;
+static const float SIN_P0 = -1.9515295891e-4f;
+static const float SIN_P1 = 8.3321608736e-3f;
+static const float SIN_P2 = -1.6666654611e-1f;
+static const float COS_P0 = 2.443315711809948e-5f;
+static const float COS_P1 = -1.388731625493765e-3f;
+static const float COS_P2 = 4.166664568298827e-2f;
+
+static inline void interpolateTail(const float * a, const float * b, float scale, float * out, int i, int n)
+{
+    for(; i < n; ++i)
+    {
+        out[i] = a[i] + scale*(b[i]-a[i]);
+    }
+}
+
+static inline void decodeScaledTail(const qint16 * in, const float * offset, const float * scale, float * out, int i, int n)
+{
+    for(; i < n; ++i)
+    {
+        out[i] = offset[i] + scale[i]*float(in[i]);
+    }
+}
+
+static inline void arrowMagnitudesTail(const float * x, const float * y, float * len, float * dirX, float * dirY, int i, int n)
+{
+    for(; i < n; ++i)
+    {
+        len[i] = std::sqrt(x[i]*x[i] + y[i]*y[i]);
+        const float inv = len[i] > 0.0f ? 1.0f/len[i] : 0.0f;
+        dirX[i] = x[i]*inv;
+        dirY[i] = y[i]*inv;
+    }
+}
+
+// SSE4.2
+
+TARGET_SSE42 static void interpolateSse42(const float * a, const float * b, float scale, float * out, int n)
+{
+    const __m128 s = _mm_set1_ps(scale);
+    int i = 0;
+    for(; i+4 <= n; i += 4)
+    {
+        const __m128 va = _mm_loadu_ps(a+i);
+        const __m128 vb = _mm_loadu_ps(b+i);
+        _mm_storeu_ps(out+i,_mm_add_ps(va,_mm_mul_ps(s,_mm_sub_ps(vb,va))));
+    }
+    interpolateTail(a,b,scale,out,i,n);
+}
+
+TARGET_SSE42 static void prefixSumSse42(const float * in, float start, float * out, int n)
+{
+    __m128 carry = _mm_set1_ps(start);
+    int i = 0;
+    for(; i+4 <= n; i += 4)
+    {
+        __m128 v = _mm_loadu_ps(in+i);
+        v = _mm_add_ps(v,_mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(v),4)));
+        v = _mm_add_ps(v,_mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(v),8)));
+        v = _mm_add_ps(v,carry);
+        _mm_storeu_ps(out+i,v);
+        carry = _mm_shuffle_ps(v,v,_MM_SHUFFLE(3,3,3,3));
+    }
+    float sum = _mm_cvtss_f32(carry);
+    for(; i < n; ++i)
+    {
+        sum += in[i];
+        out[i] = sum;
+    }
+}
+
+TARGET_SSE42 static inline void sinCos4(__m128 x, __m128 & s, __m128 & c)
+{
+    const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(int(0x80000000u)));
+    __m128 signSin = _mm_and_ps(x,signMask);
+    x = _mm_andnot_ps(signMask,x);
+    __m128i j = _mm_cvttps_epi32(_mm_mul_ps(x,_mm_set1_ps(FOUR_OVER_PI)));
+    j = _mm_and_si128(_mm_add_epi32(j,_mm_set1_epi32(1)),_mm_set1_epi32(~1));
+    const __m128 y = _mm_cvtepi32_ps(j);
+    signSin = _mm_xor_ps(signSin,_mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(j,_mm_set1_epi32(4)),29)));
+    const __m128 signCos = _mm_castsi128_ps(_mm_slli_epi32(_mm_andnot_si128(_mm_sub_epi32(j,_mm_set1_epi32(2)),_mm_set1_epi32(4)),29));
+    const __m128 sinOctant = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(j,_mm_set1_epi32(2)),_mm_setzero_si128()));
+    x = _mm_add_ps(x,_mm_mul_ps(y,_mm_set1_ps(DP1)));
+    x = _mm_add_ps(x,_mm_mul_ps(y,_mm_set1_ps(DP2)));
+    x = _mm_add_ps(x,_mm_mul_ps(y,_mm_set1_ps(DP3)));
+    const __m128 z = _mm_mul_ps(x,x);
+    __m128 cosPoly = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(COS_P0),z),_mm_set1_ps(COS_P1));
+    cosPoly = _mm_add_ps(_mm_mul_ps(cosPoly,z),_mm_set1_ps(COS_P2));
+    cosPoly = _mm_mul_ps(_mm_mul_ps(cosPoly,z),z);
+    cosPoly = _mm_add_ps(_mm_sub_ps(cosPoly,_mm_mul_ps(z,_mm_set1_ps(0.5f))),_mm_set1_ps(1.0f));
+    __m128 sinPoly = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(SIN_P0),z),_mm_set1_ps(SIN_P1));
+    sinPoly = _mm_add_ps(_mm_mul_ps(sinPoly,z),_mm_set1_ps(SIN_P2));
+    sinPoly = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(sinPoly,z),x),x);
+    s = _mm_xor_ps(_mm_blendv_ps(cosPoly,sinPoly,sinOctant),signSin);
+    c = _mm_xor_ps(_mm_blendv_ps(sinPoly,cosPoly,sinOctant),signCos);
+}
+
+TARGET_SSE42 static void sinCosSse42(const float * x, float * s, float * c, int n)
+{
+    int i = 0;
+    __m128 vs,vc;
+    for(; i+4 <= n; i += 4)
+    {
+        sinCos4(_mm_loadu_ps(x+i),vs,vc);
+        _mm_storeu_ps(s+i,vs);
+        _mm_storeu_ps(c+i,vc);
+    }
+    if(i < n)
+    {
+        float in[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        float outS[4];
+        float outC[4];
+        for(int k = 0; i+k < n; ++k)
+        {
+            in[k] = x[i+k];
+        }
+        sinCos4(_mm_loadu_ps(in),vs,vc);
+        _mm_storeu_ps(outS,vs);
+        _mm_storeu_ps(outC,vc);
+        for(int k = 0; i+k < n; ++k)
+        {
+            s[i+k] = outS[k];
+            c[i+k] = outC[k];
+        }
+    }
+}
+
+TARGET_SSE42 static void arrowMagnitudesSse42(const float * x, const float * y, float * len, float * dirX, float * dirY, int n)
+{
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 zero = _mm_setzero_ps();
+    int i = 0;
+    for(; i+4 <= n; i += 4)
+    {
+        const __m128 vx = _mm_loadu_ps(x+i);
+        const __m128 vy = _mm_loadu_ps(y+i);
+        const __m128 l = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(vx,vx),_mm_mul_ps(vy,vy)));
+        const __m128 inv = _mm_and_ps(_mm_cmpgt_ps(l,zero),_mm_div_ps(one,l));
+        _mm_storeu_ps(len+i,l);
+        _mm_storeu_ps(dirX+i,_mm_mul_ps(vx,inv));
+        _mm_storeu_ps(dirY+i,_mm_mul_ps(vy,inv));
+    }
+    arrowMagnitudesTail(x,y,len,dirX,dirY,i,n);
+}
+
+TARGET_SSE42 static inline __m128 decodeHalf4(__m128i h)
+{
+    const __m128 magic = _mm_castsi128_ps(_mm_set1_epi32(int(HALF_MAGIC)));
+    const __m128 infNan = _mm_castsi128_ps(_mm_set1_epi32(int(HALF_INF_NAN)));
+    __m128 f = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(h,_mm_set1_epi32(0x7fff)),13)),magic);
+    f = _mm_or_ps(f,_mm_and_ps(_mm_cmpge_ps(f,infNan),_mm_castsi128_ps(_mm_set1_epi32(255 << 23))));
+    return _mm_or_ps(f,_mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(h,_mm_set1_epi32(0x8000)),16)));
+}
+
+TARGET_SSE42 static void decodeHalfSse42(const quint16 * in, float * out, int n)
+{
+    int i = 0;
+    for(; i+4 <= n; i += 4)
+    {
+        _mm_storeu_ps(out+i,decodeHalf4(_mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(in+i)))));
+    }
+    if(i < n)
+    {
+        quint16 h[4] = { 0, 0, 0, 0 };
+        float f[4];
+        for(int k = 0; i+k < n; ++k)
+        {
+            h[k] = in[i+k];
+        }
+        _mm_storeu_ps(f,decodeHalf4(_mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(h)))));
+        for(int k = 0; i+k < n; ++k)
+        {
+            out[i+k] = f[k];
+        }
+    }
+}
+
+TARGET_SSE42 static void decodeScaledSse42(const qint16 * in, const float * offset, const float * scale, float * out, int n)
+{
+    int i = 0;
+    for(; i+4 <= n; i += 4)
+    {
+        const __m128 q = _mm_cvtepi32_ps(_mm_cvtepi16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(in+i))));
+        _mm_storeu_ps(out+i,_mm_add_ps(_mm_loadu_ps(offset+i),_mm_mul_ps(_mm_loadu_ps(scale+i),q)));
+    }
+    decodeScaledTail(in,offset,scale,out,i,n);
+}
+
+extern const simdKernels sse42Kernels =
+{
+    SIMD_SSE42,
+    interpolateSse42,
+    prefixSumSse42,
+    sinCosSse42,
+    arrowMagnitudesSse42,
+    decodeHalfSse42,
+    decodeScaledSse42
+};
+
+// AVX2
+
+TARGET_AVX2 static void interpolateAvx2(const float * a, const float * b, float scale, float * out, int n)
+{
+    const __m256 s = _mm256_set1_ps(scale);
+    int i = 0;
+    for(; i+8 <= n; i += 8)
+    {
+        const __m256 va = _mm256_loadu_ps(a+i);
+        const __m256 vb = _mm256_loadu_ps(b+i);
+        _mm256_storeu_ps(out+i,_mm256_add_ps(va,_mm256_mul_ps(s,_mm256_sub_ps(vb,va))));
+    }
+    interpolateTail(a,b,scale,out,i,n);
+}
+
+TARGET_AVX2 static void prefixSumAvx2(const float * in, float start, float * out, int n)
+{
+    __m256 carry = _mm256_set1_ps(start);
+    int i = 0;
+    for(; i+8 <= n; i += 8)
+    {
+        // Scan both 128 bit lanes, then add the total of the low lane to the high one
+        __m256 v = _mm256_loadu_ps(in+i);
+        v = _mm256_add_ps(v,_mm256_castsi256_ps(_mm256_slli_si256(_mm256_castps_si256(v),4)));
+        v = _mm256_add_ps(v,_mm256_castsi256_ps(_mm256_slli_si256(_mm256_castps_si256(v),8)));
+        const __m256 low = _mm256_permute2f128_ps(v,v,0x08);
+        v = _mm256_add_ps(v,_mm256_shuffle_ps(low,low,_MM_SHUFFLE(3,3,3,3)));
+        v = _mm256_add_ps(v,carry);
+        _mm256_storeu_ps(out+i,v);
+        const __m256 high = _mm256_permute2f128_ps(v,v,0x11);
+        carry = _mm256_shuffle_ps(high,high,_MM_SHUFFLE(3,3,3,3));
+    }
+    float sum = _mm256_cvtss_f32(carry);
+    for(; i < n; ++i)
+    {
+        sum += in[i];
+        out[i] = sum;
+    }
+}
+
+TARGET_AVX2 static inline void sinCos8(__m256 x, __m256 & s, __m256 & c)
+{
+    const __m256 signMask = _mm256_castsi256_ps(_mm256_set1_epi32(int(0x80000000u)));
+    __m256 signSin = _mm256_and_ps(x,signMask);
+    x = _mm256_andnot_ps(signMask,x);
+    __m256i j = _mm256_cvttps_epi32(_mm256_mul_ps(x,_mm256_set1_ps(FOUR_OVER_PI)));
+    j = _mm256_and_si256(_mm256_add_epi32(j,_mm256_set1_epi32(1)),_mm256_set1_epi32(~1));
+    const __m256 y = _mm256_cvtepi32_ps(j);
+    signSin = _mm256_xor_ps(signSin,_mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(j,_mm256_set1_epi32(4)),29)));
+    const __m256 signCos = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_andnot_si256(_mm256_sub_epi32(j,_mm256_set1_epi32(2)),_mm256_set1_epi32(4)),29));
+    const __m256 sinOctant = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(j,_mm256_set1_epi32(2)),_mm256_setzero_si256()));
+    x = _mm256_add_ps(x,_mm256_mul_ps(y,_mm256_set1_ps(DP1)));
+    x = _mm256_add_ps(x,_mm256_mul_ps(y,_mm256_set1_ps(DP2)));
+    x = _mm256_add_ps(x,_mm256_mul_ps(y,_mm256_set1_ps(DP3)));
+    const __m256 z = _mm256_mul_ps(x,x);
+    __m256 cosPoly = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(COS_P0),z),_mm256_set1_ps(COS_P1));
+    cosPoly = _mm256_add_ps(_mm256_mul_ps(cosPoly,z),_mm256_set1_ps(COS_P2));
+    cosPoly = _mm256_mul_ps(_mm256_mul_ps(cosPoly,z),z);
+    cosPoly = _mm256_add_ps(_mm256_sub_ps(cosPoly,_mm256_mul_ps(z,_mm256_set1_ps(0.5f))),_mm256_set1_ps(1.0f));
+    __m256 sinPoly = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(SIN_P0),z),_mm256_set1_ps(SIN_P1));
+    sinPoly = _mm256_add_ps(_mm256_mul_ps(sinPoly,z),_mm256_set1_ps(SIN_P2));
+    sinPoly = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(sinPoly,z),x),x);
+    s = _mm256_xor_ps(_mm256_blendv_ps(cosPoly,sinPoly,sinOctant),signSin);
+    c = _mm256_xor_ps(_mm256_blendv_ps(sinPoly,cosPoly,sinOctant),signCos);
+}
+
+TARGET_AVX2 static void sinCosAvx2(const float * x, float * s, float * c, int n)
+{
+    int i = 0;
+    __m256 vs,vc;
+    for(; i+8 <= n; i += 8)
+    {
+        sinCos8(_mm256_loadu_ps(x+i),vs,vc);
+        _mm256_storeu_ps(s+i,vs);
+        _mm256_storeu_ps(c+i,vc);
+    }
+    if(i < n)
+    {
+        // Lanes past the end are neither read nor written
+        const __m256i lanes = _mm256_setr_epi32(0,1,2,3,4,5,6,7);
+        const __m256i mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(n-i),lanes);
+        sinCos8(_mm256_maskload_ps(x+i,mask),vs,vc);
+        _mm256_maskstore_ps(s+i,mask,vs);
+        _mm256_maskstore_ps(c+i,mask,vc);
+    }
+}
+
+TARGET_AVX2 static void arrowMagnitudesAvx2(const float * x, const float * y, float * len, float * dirX, float * dirY, int n)
+{
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 zero = _mm256_setzero_ps();
+    int i = 0;
+    for(; i+8 <= n; i += 8)
+    {
+        const __m256 vx = _mm256_loadu_ps(x+i);
+        const __m256 vy = _mm256_loadu_ps(y+i);
+        const __m256 l = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(vx,vx),_mm256_mul_ps(vy,vy)));
+        const __m256 inv = _mm256_and_ps(_mm256_cmp_ps(l,zero,_CMP_GT_OQ),_mm256_div_ps(one,l));
+        _mm256_storeu_ps(len+i,l);
+        _mm256_storeu_ps(dirX+i,_mm256_mul_ps(vx,inv));
+        _mm256_storeu_ps(dirY+i,_mm256_mul_ps(vy,inv));
+    }
+    arrowMagnitudesTail(x,y,len,dirX,dirY,i,n);
+}
+
+TARGET_AVX2 static inline __m256 decodeHalf8(__m256i h)
+{
+    const __m256 magic = _mm256_castsi256_ps(_mm256_set1_epi32(int(HALF_MAGIC)));
+    const __m256 infNan = _mm256_castsi256_ps(_mm256_set1_epi32(int(HALF_INF_NAN)));
+    __m256 f = _mm256_mul_ps(_mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(h,_mm256_set1_epi32(0x7fff)),13)),magic);
+    f = _mm256_or_ps(f,_mm256_and_ps(_mm256_cmp_ps(f,infNan,_CMP_GE_OQ),_mm256_castsi256_ps(_mm256_set1_epi32(255 << 23))));
+    return _mm256_or_ps(f,_mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(h,_mm256_set1_epi32(0x8000)),16)));
+}
+
+TARGET_AVX2 static void decodeHalfAvx2(const quint16 * in, float * out, int n)
+{
+    int i = 0;
+    for(; i+8 <= n; i += 8)
+    {
+        _mm256_storeu_ps(out+i,decodeHalf8(_mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in+i)))));
+    }
+    if(i < n)
+    {
+        quint16 h[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+        for(int k = 0; i+k < n; ++k)
+        {
+            h[k] = in[i+k];
+        }
+        const __m256i mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(n-i),_mm256_setr_epi32(0,1,2,3,4,5,6,7));
+        _mm256_maskstore_ps(out+i,mask,decodeHalf8(_mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(h)))));
+    }
+}
+
+TARGET_AVX2 static void decodeScaledAvx2(const qint16 * in, const float * offset, const float * scale, float * out, int n)
+{
+    int i = 0;
+    for(; i+8 <= n; i += 8)
+    {
+        const __m256 q = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in+i))));
+        _mm256_storeu_ps(out+i,_mm256_add_ps(_mm256_loadu_ps(offset+i),_mm256_mul_ps(_mm256_loadu_ps(scale+i),q)));
+    }
+    decodeScaledTail(in,offset,scale,out,i,n);
+}
+
+extern const simdKernels avx2Kernels =
+{
+    SIMD_AVX2,
+    interpolateAvx2,
+    prefixSumAvx2,
+    sinCosAvx2,
+    arrowMagnitudesAvx2,
+    decodeHalfAvx2,
+    decodeScaledAvx2
+};
+
+// AVX-512, the tail of every loop is one masked iteration
+
+TARGET_AVX512 static inline __mmask16 getTailMask(int remaining)
+{
+    return remaining >= 16 ? __mmask16(0xffff) : __mmask16((1u << remaining)-1);
+}
+
+TARGET_AVX512 static void interpolateAvx512(const float * a, const float * b, float scale, float * out, int n)
+{
+    const __m512 s = _mm512_set1_ps(scale);
+    for(int i = 0; i < n; i += 16)
+    {
+        const __mmask16 m = getTailMask(n-i);
+        const __m512 va = _mm512_maskz_loadu_ps(m,a+i);
+        const __m512 vb = _mm512_maskz_loadu_ps(m,b+i);
+        _mm512_mask_storeu_ps(out+i,m,_mm512_add_ps(va,_mm512_mul_ps(s,_mm512_sub_ps(vb,va))));
+    }
+}
+
+TARGET_AVX512 static void prefixSumAvx512(const float * in, float start, float * out, int n)
+{
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i last = _mm512_set1_epi32(15);
+    __m512 carry = _mm512_set1_ps(start);
+    for(int i = 0; i < n; i += 16)
+    {
+        // alignr against zero shifts the elements up by 1, 2, 4 and 8 across the whole register
+        const __mmask16 m = getTailMask(n-i);
+        __m512 v = _mm512_maskz_loadu_ps(m,in+i);
+        v = _mm512_add_ps(v,_mm512_castsi512_ps(_mm512_alignr_epi32(_mm512_castps_si512(v),zero,15)));
+        v = _mm512_add_ps(v,_mm512_castsi512_ps(_mm512_alignr_epi32(_mm512_castps_si512(v),zero,14)));
+        v = _mm512_add_ps(v,_mm512_castsi512_ps(_mm512_alignr_epi32(_mm512_castps_si512(v),zero,12)));
+        v = _mm512_add_ps(v,_mm512_castsi512_ps(_mm512_alignr_epi32(_mm512_castps_si512(v),zero,8)));
+        v = _mm512_add_ps(v,carry);
+        _mm512_mask_storeu_ps(out+i,m,v);
+        carry = _mm512_permutexvar_ps(last,v);
+    }
+}
+
+TARGET_AVX512 static inline void sinCos16(__m512 x, __m512 & s, __m512 & c)
+{
+    const __m512i signMask = _mm512_set1_epi32(int(0x80000000u));
+    __m512i signSin = _mm512_and_si512(_mm512_castps_si512(x),signMask);
+    x = _mm512_castsi512_ps(_mm512_andnot_si512(signMask,_mm512_castps_si512(x)));
+    __m512i j = _mm512_cvttps_epi32(_mm512_mul_ps(x,_mm512_set1_ps(FOUR_OVER_PI)));
+    j = _mm512_and_si512(_mm512_add_epi32(j,_mm512_set1_epi32(1)),_mm512_set1_epi32(~1));
+    const __m512 y = _mm512_cvtepi32_ps(j);
+    signSin = _mm512_xor_si512(signSin,_mm512_slli_epi32(_mm512_and_si512(j,_mm512_set1_epi32(4)),29));
+    const __m512i signCos = _mm512_slli_epi32(_mm512_andnot_si512(_mm512_sub_epi32(j,_mm512_set1_epi32(2)),_mm512_set1_epi32(4)),29);
+    const __mmask16 sinOctant = _mm512_testn_epi32_mask(j,_mm512_set1_epi32(2));
+    x = _mm512_add_ps(x,_mm512_mul_ps(y,_mm512_set1_ps(DP1)));
+    x = _mm512_add_ps(x,_mm512_mul_ps(y,_mm512_set1_ps(DP2)));
+    x = _mm512_add_ps(x,_mm512_mul_ps(y,_mm512_set1_ps(DP3)));
+    const __m512 z = _mm512_mul_ps(x,x);
+    __m512 cosPoly = _mm512_add_ps(_mm512_mul_ps(_mm512_set1_ps(COS_P0),z),_mm512_set1_ps(COS_P1));
+    cosPoly = _mm512_add_ps(_mm512_mul_ps(cosPoly,z),_mm512_set1_ps(COS_P2));
+    cosPoly = _mm512_mul_ps(_mm512_mul_ps(cosPoly,z),z);
+    cosPoly = _mm512_add_ps(_mm512_sub_ps(cosPoly,_mm512_mul_ps(z,_mm512_set1_ps(0.5f))),_mm512_set1_ps(1.0f));
+    __m512 sinPoly = _mm512_add_ps(_mm512_mul_ps(_mm512_set1_ps(SIN_P0),z),_mm512_set1_ps(SIN_P1));
+    sinPoly = _mm512_add_ps(_mm512_mul_ps(sinPoly,z),_mm512_set1_ps(SIN_P2));
+    sinPoly = _mm512_add_ps(_mm512_mul_ps(_mm512_mul_ps(sinPoly,z),x),x);
+    s = _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(_mm512_mask_blend_ps(sinOctant,cosPoly,sinPoly)),signSin));
+    c = _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(_mm512_mask_blend_ps(sinOctant,sinPoly,cosPoly)),signCos));
+}
+
+TARGET_AVX512 static void sinCosAvx512(const float * x, float * s, float * c, int n)
+{
+    __m512 vs,vc;
+    for(int i = 0; i < n; i += 16)
+    {
+        const __mmask16 m = getTailMask(n-i);
+        sinCos16(_mm512_maskz_loadu_ps(m,x+i),vs,vc);
+        _mm512_mask_storeu_ps(s+i,m,vs);
+        _mm512_mask_storeu_ps(c+i,m,vc);
+    }
+}
+
+TARGET_AVX512 static void arrowMagnitudesAvx512(const float * x, const float * y, float * len, float * dirX, float * dirY, int n)
+{
+    const __m512 one = _mm512_set1_ps(1.0f);
+    const __m512 zero = _mm512_setzero_ps();
+    for(int i = 0; i < n; i += 16)
+    {
+        const __mmask16 m = getTailMask(n-i);
+        const __m512 vx = _mm512_maskz_loadu_ps(m,x+i);
+        const __m512 vy = _mm512_maskz_loadu_ps(m,y+i);
+        const __m512 l = _mm512_sqrt_ps(_mm512_add_ps(_mm512_mul_ps(vx,vx),_mm512_mul_ps(vy,vy)));
+        const __m512 inv = _mm512_maskz_div_ps(_mm512_cmp_ps_mask(l,zero,_CMP_GT_OQ),one,l);
+        _mm512_mask_storeu_ps(len+i,m,l);
+        _mm512_mask_storeu_ps(dirX+i,m,_mm512_mul_ps(vx,inv));
+        _mm512_mask_storeu_ps(dirY+i,m,_mm512_mul_ps(vy,inv));
+    }
+}
+
+// 16 bit lanes can only be loaded with a mask with AVX-512BW, so the tail goes through a buffer
+TARGET_AVX512 static inline __m256i loadShorts16(const void * in, int remaining)
+{
+    if(remaining >= 16)
+    {
+        return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in));
+    }
+    quint16 buffer[16] = { 0 };
+    std::memcpy(buffer,in,size_t(remaining)*sizeof(quint16));
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(buffer));
+}
+
+TARGET_AVX512 static void decodeHalfAvx512(const quint16 * in, float * out, int n)
+{
+    for(int i = 0; i < n; i += 16)
+    {
+        _mm512_mask_storeu_ps(out+i,getTailMask(n-i),_mm512_cvtph_ps(loadShorts16(in+i,n-i)));
+    }
+}
+
+TARGET_AVX512 static void decodeScaledAvx512(const qint16 * in, const float * offset, const float * scale, float * out, int n)
+{
+    for(int i = 0; i < n; i += 16)
+    {
+        const __mmask16 m = getTailMask(n-i);
+        const __m512 q = _mm512_cvtepi32_ps(_mm512_cvtepi16_epi32(loadShorts16(in+i,n-i)));
+        _mm512_mask_storeu_ps(out+i,m,_mm512_add_ps(_mm512_maskz_loadu_ps(m,offset+i),_mm512_mul_ps(_mm512_maskz_loadu_ps(m,scale+i),q)));
+    }
+}
+
+extern const simdKernels avx512Kernels =
+{
+    SIMD_AVX512,
+    interpolateAvx512,
+    prefixSumAvx512,
+    sinCosAvx512,
+    arrowMagnitudesAvx512,
+    decodeHalfAvx512,
+    decodeScaledAvx512
+};
+
+#endif
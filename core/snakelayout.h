@@ -0,0 +1,95 @@
+#ifndef SNAKELAYOUT_H
+#define SNAKELAYOUT_H
+
+#include <cmath>
+#include <utility>
+#include "matlabinterface.h"
+#include "dimensions.h"
+
+// Where the whole-snake overlays go relative to the robot, shared by the window and the exporter.
+// Positions are in scene units.
+
+inline std::pair<float,float> getTotalForce(const snakeFrame & frame)
+{
+    return std::pair<float,float>(frame.aggregates.totalForceX,frame.aggregates.totalForceY);
+}
+
+inline std::pair<float,float> getMCSpeed(const snakeFrame & frame)
+{
+    return std::pair<float,float>(frame.aggregates.mcSpeedX,frame.aggregates.mcSpeedY);
+}
+
+inline std::pair<float,float> getMCPos(const snakeFrame & frame)
+{
+    return std::pair<float,float>(SCALE_ALL_FACTOR*frame.aggregates.mcX,SCALE_ALL_FACTOR*frame.aggregates.mcY);
+}
+
+inline float getSnakeTangent(const snakeFrame & frame)
+{
+    // derive this from the forward speed
+    std::pair<float,float> spd = getMCSpeed(frame);
+    float avgtheta = atan2(spd.second,spd.first);
+    return avgtheta;
+}
+
+inline float getSnakeLength(const snakeFrame & frame)
+{
+    typedef robot_dimensions<SCALE_ALL_FACTOR> RD;
+    float len = 0.0f;
+    for(unsigned int i = 0; i < frame.sections.size(); ++i)
+    {
+        len += RD::segmentMCtoBackwardJointConnection(i) +
+               RD::segmentMCtoForwardJointConnection(i);
+    }
+    return len;
+}
+
+inline std::pair<float,float> getMCSpeedArrowPos(const snakeFrame & frame)
+{
+    float len = getSnakeLength(frame);
+    float tangentAngle = getSnakeTangent(frame);
+
+    float normalLen = len*0.3f; // Arbitrary constant, whatever seems fit
+    float normalX = normalLen*cos(tangentAngle+3.14f/2.0f);
+    float normalY = normalLen*sin(tangentAngle+3.14f/2.0f);
+    float tangentOffsetLen = len*0.15f;
+    float tangentX = tangentOffsetLen*cos(tangentAngle);
+    float tangentY = tangentOffsetLen*sin(tangentAngle);
+
+    std::pair<float,float> mcPos = getMCPos(frame);
+
+    return std::pair<float,float>(mcPos.first + normalX + tangentX, mcPos.second + normalY + tangentY);
+}
+
+inline std::pair<float,float> getMCForceArrowPos(const snakeFrame & frame)
+{
+    float len = getSnakeLength(frame);
+    float tangentAngle = getSnakeTangent(frame);
+
+    float normalLen = len*0.3f; // Arbitrary constant, whatever seems fit
+    float normalX = normalLen*cos(tangentAngle+3.14f/2.0f);
+    float normalY = normalLen*sin(tangentAngle+3.14f/2.0f);
+    float tangentOffsetLen = -1.0f*len*0.15f;
+    float tangentX = tangentOffsetLen*cos(tangentAngle);
+    float tangentY = tangentOffsetLen*sin(tangentAngle);
+
+    std::pair<float,float> mcPos = getMCPos(frame);
+
+    return std::pair<float,float>(mcPos.first + normalX + tangentX, mcPos.second + normalY + tangentY);
+}
+
+inline std::pair<float,float> getTorqueDisplayPos(const snakeFrame & frame)
+{
+    float len = getSnakeLength(frame);
+    float tangentAngle = getSnakeTangent(frame);
+
+    float normalLen = len*0.4f; // Arbitrary constant, whatever seems fit
+    float normalX = -normalLen*cos(tangentAngle+3.14f/2.0f);
+    float normalY = -normalLen*sin(tangentAngle+3.14f/2.0f);
+
+    std::pair<float,float> mcPos = getMCPos(frame);
+
+    return std::pair<float,float>(mcPos.first + normalX, mcPos.second + normalY);
+}
+
+#endif // SNAKELAYOUT_H
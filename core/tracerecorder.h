@@ -0,0 +1,236 @@
+#ifndef TRACERECORDER_H
+#define TRACERECORDER_H
+
+#include <QFile>
+#include <QString>
+#include <QByteArray>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <vector>
+
+// Records begin/end events of the frame pipeline and the worker threads and writes them as a
+// Chrome trace (chrome://tracing, ui.perfetto.dev). Every thread appends to its own buffer without
+// locking, the buffers are only read when the recording is written out. Every recording has its
+// own generation, a buffer still holding an older one is emptied by its thread on its next event.
+// Event names must be string literals, only the pointer is stored.
+class traceRecorder
+{
+public:
+    typedef std::chrono::steady_clock clock;
+
+    static bool isRecording()
+    {
+        return recording().load(std::memory_order_relaxed);
+    }
+
+    static void start()
+    {
+        registry & r = getRegistry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        // Released so a thread that sees the new generation also sees the last recording read out
+        generation().fetch_add(1,std::memory_order_acq_rel);
+        r.epoch = clock::now();
+        recording().store(true,std::memory_order_release);
+    }
+
+    // Stops recording and writes everything recorded since start, returns false if the file can't
+    // be written
+    static bool stop(const QString & fileName)
+    {
+        recording().store(false,std::memory_order_release);
+        registry & r = getRegistry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        QFile out(fileName);
+        if(!out.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        {
+            return false;
+        }
+        out.write("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        bool firstEvent = true;
+        for(unsigned int i = 0; i < r.buffers.size(); ++i)
+        {
+            const threadBuffer * b = r.buffers[i];
+            QByteArray line;
+            line += firstEvent ? "" : ",\n";
+            firstEvent = false;
+            line += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" + QByteArray::number(b->id) +
+                    ",\"args\":{\"name\":\"" + b->name + "\"}}";
+            out.write(line);
+            // Only what was complete when the count was published is read, and nothing of a
+            // buffer its thread has not reset since the recording started
+            const bool current = b->generation.load(std::memory_order_acquire) == generation().load(std::memory_order_relaxed);
+            const int count = current ? b->count.load(std::memory_order_acquire) : 0;
+            for(int e = 0; e < count; ++e)
+            {
+                const event & ev = b->blocks[e/BLOCK_SIZE][e%BLOCK_SIZE];
+                line = ",\n{\"name\":\"";
+                line += ev.name;
+                line += "\",\"ph\":\"";
+                line += ev.phase;
+                line += "\",\"ts\":" + QByteArray::number(std::chrono::duration<double,std::micro>(ev.time-r.epoch).count(),'f',3) +
+                        ",\"pid\":1,\"tid\":" + QByteArray::number(b->id) + "}";
+                out.write(line);
+            }
+        }
+        out.write("\n]}\n");
+        return true;
+    }
+
+    // Names the calling thread in the trace, call from the thread itself
+    static void setThreadName(const char * name)
+    {
+        threadBuffer * b = getBuffer();
+        std::lock_guard<std::mutex> lock(getRegistry().mutex);
+        b->name = name;
+    }
+
+    // Begin event, returns the recording it belongs to for end, or -1 if nothing is recording
+    static int begin(const char * name)
+    {
+        if(!isRecording())
+        {
+            return -1;
+        }
+        const int g = generation().load(std::memory_order_acquire);
+        getBuffer()->push(name,'B',g);
+        return g;
+    }
+
+    // End event of a begin, left out unless the same recording is still running
+    static void end(const char * name, int recording)
+    {
+        if(recording >= 0 && isRecording() && generation().load(std::memory_order_acquire) == recording)
+        {
+            getBuffer()->push(name,'E',recording);
+        }
+    }
+
+private:
+    enum { BLOCK_SIZE = 16384 };
+
+    struct event
+    {
+        const char * name;
+        clock::time_point time;
+        char phase;
+    };
+
+    // Written by its own thread only. Events live in fixed blocks so appending never moves them,
+    // a new block is only allocated every BLOCK_SIZE events.
+    struct threadBuffer
+    {
+        int id;
+        QByteArray name;
+        std::vector<event*> blocks;
+        std::atomic<int> count;
+        std::atomic<int> generation;    // Recording the events belong to
+
+        threadBuffer(int id) :
+            id(id),
+            name("thread " + QByteArray::number(id)),
+            count(0),
+            generation(-1)
+        {
+        }
+
+        ~threadBuffer()
+        {
+            for(unsigned int i = 0; i < blocks.size(); ++i)
+            {
+                delete [] blocks[i];
+            }
+        }
+
+        void push(const char * name, char phase, int recording)
+        {
+            int n = count.load(std::memory_order_relaxed);
+            const int current = generation.load(std::memory_order_relaxed);
+            if(recording < current)
+            {
+                // An end that raced with a restart
+                return;
+            }
+            if(recording != current)
+            {
+                // First event of a new recording. The count is reset before the generation is
+                // published, so a reader never pairs the new generation with old events.
+                count.store(0,std::memory_order_release);
+                generation.store(recording,std::memory_order_release);
+                n = 0;
+            }
+            if(n/BLOCK_SIZE >= int(blocks.size()))
+            {
+                // Growing the block list must not race with a reader walking it
+                std::lock_guard<std::mutex> lock(getRegistry().mutex);
+                blocks.push_back(new event[BLOCK_SIZE]);
+            }
+            event & e = blocks[n/BLOCK_SIZE][n%BLOCK_SIZE];
+            e.name = name;
+            e.phase = phase;
+            e.time = clock::now();
+            count.store(n+1,std::memory_order_release);
+        }
+    };
+
+    struct registry
+    {
+        std::mutex mutex;
+        std::vector<threadBuffer*> buffers;     // Kept for the life of the program
+        clock::time_point epoch;
+    };
+
+    static std::atomic<bool> & recording()
+    {
+        static std::atomic<bool> r(false);
+        return r;
+    }
+
+    static std::atomic<int> & generation()
+    {
+        static std::atomic<int> g(0);
+        return g;
+    }
+
+    static registry & getRegistry()
+    {
+        static registry r;
+        return r;
+    }
+
+    static threadBuffer * getBuffer()
+    {
+        thread_local threadBuffer * buffer = nullptr;
+        if(!buffer)
+        {
+            registry & r = getRegistry();
+            std::lock_guard<std::mutex> lock(r.mutex);
+            buffer = new threadBuffer(int(r.buffers.size()));
+            r.buffers.push_back(buffer);
+        }
+        return buffer;
+    }
+};
+
+// Begin event now and end event when the scope is left. Only ends what it began in the same
+// recording, so a recording started or restarted in the middle of a scope has no stray end event.
+class traceScope
+{
+public:
+    traceScope(const char * name) :
+        name(name),
+        recording(traceRecorder::begin(name))
+    {
+    }
+
+    ~traceScope()
+    {
+        traceRecorder::end(name,recording);
+    }
+
+private:
+    const char * name;
+    int recording;
+};
+
+#endif // TRACERECORDER_H
@@ -0,0 +1,33 @@
+#-------------------------------------------------
+#
+# The display, built as part of SnakeRobotDisplay.pro
+#
+#-------------------------------------------------
+
+QT       += core gui
+QT       += opengl
+QT       += concurrent
+
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+
+CONFIG += c++11
+
+# Lets the compiler vectorise loops over sqrt, errno is never inspected
+gcc:QMAKE_CXXFLAGS += -fno-math-errno
+
+TARGET = display2Dmodel
+TEMPLATE = app
+
+include(core/core.pri)
+
+SOURCES += main.cpp\
+        mainwindow.cpp
+
+HEADERS  += mainwindow.h \
+    graphicsitems.h \
+    ensemble.h \
+    framescheduler.h \
+    frameprofiler.h \
+    frameexporter.h
+
+FORMS    += mainwindow.ui
@@ -0,0 +1,122 @@
+#ifndef ENSEMBLE_H
+#define ENSEMBLE_H
+
+#include <QStringList>
+#include <QVector>
+#include <QtConcurrent/QtConcurrentMap>
+#include <QtConcurrent/QtConcurrentRun>
+#include <vector>
+#include "matlabinterface.h"
+#include "kinematics.h"
+#include "graphicsitems.h"
+
+// One simulation run of an ensemble, together with the state sampled for the current frame
+struct ensembleRun
+{
+    QString fileName;
+    matlabFileInterface * file;
+    quint32 cursor;
+    snakeFrame frame;
+    std::vector<segmentPose> poses;
+};
+
+// Several .datf runs played back on a shared clock. Loading and the per-frame interpolation
+// and kinematics of each run are spread over the global thread pool.
+class snakeEnsemble
+{
+private:
+    QVector<ensembleRun*> runs;
+    QVector<QFuture<bool> > cacheSaving;   // One per run, they read from the files
+    float lastTime;
+
+    static ensembleRun* loadRun(const QString & fileName)
+    {
+        ensembleRun * r = new ensembleRun;
+        r->fileName = fileName;
+        r->file = new matlabFileInterface(fileName);
+        r->cursor = 0;
+        return r;
+    }
+
+    struct sampler
+    {
+        float t;
+        sampler(float time) : t(time) {}
+        void operator()(ensembleRun * r) const
+        {
+            const matlabFileInterface * f = r->file;
+            if(f->getNumberOfSamples() == 0)
+            {
+                return;
+            }
+            f->sampleFrame(t < f->get_lastTime() ? t : f->get_lastTime(),r->cursor,r->frame);
+            computeFramePoses(r->frame,r->poses);
+        }
+    };
+
+public:
+    snakeEnsemble() :
+        runs(),
+        cacheSaving(),
+        lastTime(0.0f)
+    {
+    }
+    ~snakeEnsemble()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        for(int i = 0; i < cacheSaving.size(); ++i)
+        {
+            cacheSaving[i].waitForFinished();
+        }
+        cacheSaving.clear();
+        for(int i = 0; i < runs.size(); ++i)
+        {
+            delete runs[i]->file;
+            delete runs[i];
+        }
+        runs.clear();
+        lastTime = 0.0f;
+    }
+
+    // Parses all files in parallel, replacing any runs loaded before
+    void load(const QStringList & fileNames)
+    {
+        clear();
+        runs = QtConcurrent::blockingMapped<QVector<ensembleRun*> >(fileNames, &snakeEnsemble::loadRun);
+        for(int i = 0; i < runs.size(); ++i)
+        {
+            // Written behind the window, the caches are only needed on the next open
+            cacheSaving.append(QtConcurrent::run(runs[i]->file,&matlabFileInterface::saveCache,static_cast<const runStatistics*>(nullptr)));
+            if(runs[i]->file->getNumberOfSamples() > 0 && runs[i]->file->get_lastTime() > lastTime)
+            {
+                lastTime = runs[i]->file->get_lastTime();
+            }
+        }
+    }
+
+    // Interpolates every run at time t and chains its segments, one run per pool task.
+    // Runs that ended before t are held at their last sample.
+    void sampleAt(float t)
+    {
+        QtConcurrent::blockingMap(runs, sampler(t));
+    }
+
+    int size() const
+    {
+        return runs.size();
+    }
+    const ensembleRun & run(int i) const
+    {
+        return *runs[i];
+    }
+    float get_lastTime() const
+    {
+        return lastTime;
+    }
+};
+
+#endif // ENSEMBLE_H
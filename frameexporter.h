@@ -0,0 +1,456 @@
+#ifndef FRAMEEXPORTER_H
+#define FRAMEEXPORTER_H
+
+#include <QString>
+#include <QImage>
+#include <QPainter>
+#include <QTransform>
+#include <QDir>
+#include <QThread>
+#include <QtConcurrent/QtConcurrent>
+#include <QStyleOptionGraphicsItem>
+#include <QGraphicsScene>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include "matlabinterface.h"
+#include "graphicsitems.h"
+#include "kinematics.h"
+#include "snakelayout.h"
+
+struct exportOptions
+{
+    QString inputFile;
+    QString outputDirectory;
+    float fps;
+    int width;
+    int height;
+    float begin;
+    float end;          // Negative means the end of the recording
+    bool followCM;      // Otherwise the whole run is framed once
+    int heatChannel;    // -1 for the plain colour, otherwise a sectionChannel
+    bool showForces;
+    bool showSpeeds;
+    bool showTorques;
+    bool showTorqueHistory;
+    bool showTotals;
+    bool showTrails;
+
+    exportOptions() :
+        fps(50.0f),
+        width(1280),
+        height(720),
+        begin(0.0f),
+        end(-1.0f),
+        followCM(true),
+        heatChannel(-1),
+        showForces(true),
+        showSpeeds(true),
+        showTorques(true),
+        showTorqueHistory(false),
+        showTotals(true),
+        showTrails(true)
+    {
+    }
+};
+
+// The same items the window puts in its scene, but owned and painted directly without a
+// QGraphicsScene so that every export thread can have its own set and its own painter.
+class snakeRenderer
+{
+public:
+    enum { TRAIL_CAPACITY = 4096 };
+
+    snakeRenderer(const matlabFileInterface * file, const exportOptions & options, const snakeFrame & first) :
+        file(file),
+        options(options),
+        trailSample(-1),
+        scene(nullptr)
+    {
+        const int numberOfSegments = int(first.sections.size());
+        headTrail = new GraphicsTrailItem(TRAIL_CAPACITY,Qt::darkCyan);
+        mcTrail = new GraphicsTrailItem(TRAIL_CAPACITY,Qt::magenta);
+        totalForce = new GraphicsArrowItem(Qt::yellow);
+        totalSpeed = new GraphicsArrowItem(Qt::blue);
+        torques = new GraphicsTorqueDisplay(0.25f,getSnakeLength(first),numberOfSegments-1,Qt::red);
+        torques->setShowHistory(options.showTorqueHistory);
+        forceField = new GraphicsArrowFieldItem(Qt::yellow);
+        speedField = new GraphicsArrowFieldItem(Qt::blue);
+        for(int i = 0; i < numberOfSegments; ++i)
+        {
+            segments.push_back(new GraphicsSegmentItem(i,numberOfSegments));
+        }
+        snakeLine = new GraphicsSnakeLineItem(Qt::green);
+        // Back to front, same z order as in the window
+        if(options.showTotals)
+        {
+            items.push_back(totalForce);
+            items.push_back(totalSpeed);
+        }
+        if(options.showTorques)
+        {
+            items.push_back(torques);
+        }
+        if(options.showTrails)
+        {
+            items.push_back(headTrail);
+            items.push_back(mcTrail);
+        }
+        items.insert(items.end(),segments.begin(),segments.end());
+        items.push_back(snakeLine);
+        if(options.showForces)
+        {
+            items.push_back(forceField);
+        }
+        if(options.showSpeeds)
+        {
+            items.push_back(speedField);
+        }
+        if(options.heatChannel >= 0)
+        {
+            heatmap.setRange(file->getChannelMin(options.heatChannel),file->getChannelMax(options.heatChannel));
+        }
+    }
+
+    ~snakeRenderer()
+    {
+        if(scene)
+        {
+            for(unsigned int i = 0; i < items.size(); ++i)
+            {
+                scene->removeItem(items[i]);
+            }
+        }
+        delete headTrail;
+        delete mcTrail;
+        delete totalForce;
+        delete totalSpeed;
+        delete torques;
+        delete forceField;
+        delete speedField;
+        delete snakeLine;
+        for(unsigned int i = 0; i < segments.size(); ++i)
+        {
+            delete segments[i];
+        }
+    }
+
+    // Puts the drawn items in a scene as well, so their updates go through the scene like in the
+    // window. They are taken out again when the renderer is deleted.
+    void addToScene(QGraphicsScene * s)
+    {
+        scene = s;
+        for(unsigned int i = 0; i < items.size(); ++i)
+        {
+            items[i]->setZValue(i);
+            scene->addItem(items[i]);
+        }
+    }
+
+    // Feeds a frame before the first exported one into the torque history only, so a chunk
+    // starts with the same history as if every frame before it had been rendered
+    void warmUp(const snakeFrame & frame)
+    {
+        setTorques(frame);
+    }
+
+    void setFrame(const snakeFrame & frame)
+    {
+        const std::vector<snakeSectionData> & sections = frame.sections;
+        typedef robot_dimensions<SCALE_ALL_FACTOR> RD;
+        computeFramePoses(frame,poses);
+        for(unsigned int i = 0; i < segments.size(); ++i)
+        {
+            updateItemPose(segments[i],poses[i].x,poses[i].y,poses[i].rot*180/3.14,0.0f,RD::segmentMCtoBackwardJointEnd(i));
+            if(options.heatChannel >= 0)
+            {
+                segments[i]->setHeatIndex(&heatmap,heatmap.index(channelValue(sections[i],options.heatChannel)));
+            }
+        }
+        snakeLine->setPoses(poses);
+
+        const int n = int(sections.size());
+        forceX.resize(n);
+        forceY.resize(n);
+        speedX.resize(n);
+        speedY.resize(n);
+        for(int i = 0; i < n; ++i)
+        {
+            forceX[i] = sections[i].f_res_x;
+            forceY[i] = sections[i].f_res_y;
+            speedX[i] = sections[i].dx;
+            speedY[i] = sections[i].dy;
+        }
+        forceField->setField(poses,forceX.data(),forceY.data(),n,1);
+        speedField->setField(poses,speedX.data(),speedY.data(),n,1);
+
+        std::pair<float,float> pos = getMCSpeedArrowPos(frame);
+        std::pair<float,float> spd = getMCSpeed(frame);
+        totalSpeed->setPos(pos.first,pos.second);
+        totalSpeed->modify(spd.first,spd.second,true);
+        pos = getMCForceArrowPos(frame);
+        std::pair<float,float> frc = getTotalForce(frame);
+        totalForce->setPos(pos.first,pos.second);
+        totalForce->modify(frc.first*5.0f,frc.second*5.0f,true);
+
+        pos = getTorqueDisplayPos(frame);
+        torques->setPos(pos.first,pos.second);
+        torques->setRotation(getSnakeTangent(frame)*180.0f/3.14f);
+        setTorques(frame);
+
+        updateTrails(frame);
+    }
+
+    // Paints the current frame into image, sceneRect is the part of the scene that fills it
+    void render(QImage & image, const QRectF & sceneRect)
+    {
+        image.fill(Qt::gray);
+        QPainter painter(&image);
+        painter.setRenderHint(QPainter::Antialiasing);
+        const qreal scale = std::min(image.width()/sceneRect.width(),image.height()/sceneRect.height());
+        QTransform view;
+        view.translate(image.width()*0.5,image.height()*0.5);
+        view.scale(scale,scale);
+        view.translate(-sceneRect.center().x(),-sceneRect.center().y());
+        for(unsigned int i = 0; i < items.size(); ++i)
+        {
+            paintItem(painter,items[i],view);
+        }
+    }
+
+private:
+    void setTorques(const snakeFrame & frame)
+    {
+        torqueValues.resize(frame.sections.size());
+        for(unsigned int i = 0; i < frame.sections.size(); ++i)
+        {
+            torqueValues[i] = frame.sections[i].torque;
+        }
+        torques->setTorques(torqueValues.data(),std::max(0,int(torqueValues.size())-1));
+        torques->pushHistory();
+    }
+
+    void updateTrails(const snakeFrame & frame)
+    {
+        const int current = frame.sample;
+        if(current < 0)
+        {
+            return;
+        }
+        int begin = trailSample+1;
+        if(current < trailSample || current-trailSample > TRAIL_CAPACITY)
+        {
+            headTrail->clear();
+            mcTrail->clear();
+            begin = std::max(0,current-TRAIL_CAPACITY+1);
+        }
+        for(int i = begin; i <= current; ++i)
+        {
+            snakeMCPos head = file->getHeadPosition(i);
+            snakeMCPos mc = file->getMCPosition(i);
+            headTrail->push(head.x*SCALE_ALL_FACTOR,head.y*SCALE_ALL_FACTOR);
+            mcTrail->push(mc.x*SCALE_ALL_FACTOR,mc.y*SCALE_ALL_FACTOR);
+        }
+        trailSample = current;
+    }
+
+    // What the scene would do for an item and its children, without the scene
+    void paintItem(QPainter & painter, QGraphicsItem * item, const QTransform & view)
+    {
+        if(!item->isVisible())
+        {
+            return;
+        }
+        painter.setWorldTransform(item->sceneTransform()*view);
+        QStyleOptionGraphicsItem option;
+        option.exposedRect = item->boundingRect();
+        item->paint(&painter,&option,nullptr);
+        QList<QGraphicsItem*> children = item->childItems();
+        for(int i = 0; i < children.size(); ++i)
+        {
+            paintItem(painter,children[i],view);
+        }
+    }
+
+    const matlabFileInterface * file;
+    exportOptions options;
+    int trailSample;
+    QGraphicsScene * scene;
+    colorLookupTable heatmap;
+    std::vector<QGraphicsItem*> items;
+    std::vector<GraphicsSegmentItem*> segments;
+    GraphicsSnakeLineItem * snakeLine;
+    GraphicsArrowFieldItem * forceField;
+    GraphicsArrowFieldItem * speedField;
+    GraphicsArrowItem * totalForce;
+    GraphicsArrowItem * totalSpeed;
+    GraphicsTorqueDisplay * torques;
+    GraphicsTrailItem * headTrail;
+    GraphicsTrailItem * mcTrail;
+    std::vector<segmentPose> poses;
+    std::vector<float> forceX;
+    std::vector<float> forceY;
+    std::vector<float> speedX;
+    std::vector<float> speedY;
+    std::vector<float> torqueValues;
+};
+
+// Renders a recording to a numbered PNG sequence without opening a window, works with
+// -platform offscreen. Frame k shows time begin + k/fps, so the output only depends on the file
+// and the options. The frames are split into contiguous chunks rendered in parallel, each chunk
+// with its own renderer, cursor, image and painter.
+class frameExporter
+{
+public:
+    frameExporter(const exportOptions & options) :
+        options(options),
+        file(nullptr),
+        numberOfFrames(0),
+        written(0),
+        failed(0)
+    {
+    }
+
+    ~frameExporter()
+    {
+        delete file;
+    }
+
+    // Returns the number of frames written, or -1 if nothing could be exported
+    int run()
+    {
+        if(options.fps <= 0.0f || options.width <= 0 || options.height <= 0)
+        {
+            return -1;
+        }
+        file = new matlabFileInterface(options.inputFile);
+        file->saveCache();
+        if(file->getNumberOfSamples() == 0 || file->getNumberOfSections() == 0)
+        {
+            return -1;
+        }
+        if(!QDir().mkpath(options.outputDirectory))
+        {
+            return -1;
+        }
+        const float last = options.end < 0.0f ? file->get_lastTime() : std::min(options.end,file->get_lastTime());
+        if(last < options.begin)
+        {
+            return -1;
+        }
+        numberOfFrames = int((last-options.begin)*options.fps)+1;
+        if(!options.followCM)
+        {
+            sceneRect = getRunBounds();
+        }
+
+        // A few chunks per core keeps the threads busy when some frames are slower than others
+        const int numberOfChunks = std::min(numberOfFrames,std::max(1,QThread::idealThreadCount()*4));
+        std::vector<chunk> chunks(numberOfChunks);
+        for(int i = 0; i < numberOfChunks; ++i)
+        {
+            chunks[i].exporter = this;
+            chunks[i].first = int((qint64(numberOfFrames)*i)/numberOfChunks);
+            chunks[i].last = int((qint64(numberOfFrames)*(i+1))/numberOfChunks);
+        }
+        QtConcurrent::blockingMap(chunks,renderChunk);
+        return failed > 0 ? -1 : int(written);
+    }
+
+    int getNumberOfFrames() const
+    {
+        return numberOfFrames;
+    }
+
+private:
+    struct chunk
+    {
+        frameExporter * exporter;
+        int first;
+        int last;
+    };
+
+    float getFrameTime(int k) const
+    {
+        // Computed from the index every time so rounding doesn't accumulate
+        return options.begin + float(k)/options.fps;
+    }
+
+    // Everything the centres of mass and heads pass through, with room for the body around it
+    QRectF getRunBounds() const
+    {
+        float minX = std::numeric_limits<float>::max();
+        float minY = std::numeric_limits<float>::max();
+        float maxX = -std::numeric_limits<float>::max();
+        float maxY = -std::numeric_limits<float>::max();
+        for(int i = 0; i < file->getNumberOfSamples(); ++i)
+        {
+            snakeMCPos p[2] = { file->getHeadPosition(i), file->getMCPosition(i) };
+            for(int j = 0; j < 2; ++j)
+            {
+                minX = std::min(minX,p[j].x);
+                minY = std::min(minY,p[j].y);
+                maxX = std::max(maxX,p[j].x);
+                maxY = std::max(maxY,p[j].y);
+            }
+        }
+        snakeFrame f;
+        quint32 cursor = 0;
+        file->sampleFrame(0.0f,cursor,f);
+        const float margin = getSnakeLength(f);
+        return QRectF(QPointF(minX*SCALE_ALL_FACTOR-margin,minY*SCALE_ALL_FACTOR-margin),
+                      QPointF(maxX*SCALE_ALL_FACTOR+margin,maxY*SCALE_ALL_FACTOR+margin));
+    }
+
+    QRectF getFollowRect(const snakeFrame & frame) const
+    {
+        const float size = 2.5f*getSnakeLength(frame);
+        std::pair<float,float> mc = getMCPos(frame);
+        const float aspect = float(options.width)/float(options.height);
+        return QRectF(mc.first-size*aspect*0.5f,mc.second-size*0.5f,size*aspect,size);
+    }
+
+    static void renderChunk(chunk & c)
+    {
+        traceScope trace("export chunk");
+        frameExporter * e = c.exporter;
+        quint32 cursor = 0;
+        snakeFrame frame;
+        e->file->sampleFrame(e->getFrameTime(c.first),cursor,frame);
+        snakeRenderer renderer(e->file,e->options,frame);
+        if(e->options.showTorqueHistory)
+        {
+            cursor = 0;
+            for(int k = std::max(0,c.first-int(GraphicsTorqueDisplay::HISTORY_LENGTH)); k < c.first; ++k)
+            {
+                e->file->sampleFrame(e->getFrameTime(k),cursor,frame);
+                renderer.warmUp(frame);
+            }
+        }
+        QImage image(e->options.width,e->options.height,QImage::Format_ARGB32_Premultiplied);
+        for(int k = c.first; k < c.last; ++k)
+        {
+            e->file->sampleFrame(e->getFrameTime(k),cursor,frame);
+            renderer.setFrame(frame);
+            renderer.render(image,e->options.followCM ? e->getFollowRect(frame) : e->sceneRect);
+            const QString path = QDir(e->options.outputDirectory).filePath(QString("frame_%1.png").arg(k,6,10,QChar('0')));
+            if(image.save(path,"PNG"))
+            {
+                ++e->written;
+            }
+            else
+            {
+                ++e->failed;
+            }
+        }
+    }
+
+    exportOptions options;
+    matlabFileInterface * file;
+    int numberOfFrames;
+    QRectF sceneRect;
+    std::atomic<int> written;
+    std::atomic<int> failed;
+};
+
+#endif // FRAMEEXPORTER_H
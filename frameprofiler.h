@@ -0,0 +1,293 @@
+#ifndef FRAMEPROFILER_H
+#define FRAMEPROFILER_H
+
+#include <QObject>
+#include <QEvent>
+#include <QWidget>
+#include <QPainter>
+#include <QOpenGLWidget>
+#include <QFontDatabase>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include "tracerecorder.h"
+
+enum profileStage
+{
+    STAGE_FRAME,
+    STAGE_SEEK,
+    STAGE_INTERPOLATION,
+    STAGE_KINEMATICS,
+    STAGE_SCENE_UPDATE,
+    STAGE_PAINT,
+    STAGE_SWAP,
+    STAGE_LOAD,
+    NUMBER_OF_STAGES
+};
+
+inline const char * getStageName(int stage)
+{
+    static const char * names[NUMBER_OF_STAGES] = { "frame", "seek", "interpolation", "kinematics", "scene update", "paint", "swap", "load" };
+    return names[stage];
+}
+
+// Durations of the last WINDOW frames of every stage of the frame pipeline. When disabled nothing
+// but a load reads the clock, a scoped timer costs one branch. Loads are rare and happen before
+// the overlay is opened, so they are always timed and kept across a reset. Painting of the viewport is timed from its
+// paint event until the window is about to compose, and from there to the buffer swap. The same
+// span is written to the trace while one is recorded.
+class frameProfiler : public QObject
+{
+    Q_OBJECT
+
+public:
+    typedef std::chrono::steady_clock clock;
+    enum { WINDOW = 256 };
+    enum { BUCKETS = 16 };  // Powers of two from 1 us
+
+    struct summary
+    {
+        float p50;
+        float p99;
+        float max;          // Microseconds
+        int count;
+        int buckets[BUCKETS];
+    };
+
+    frameProfiler(QObject * parent = 0) :
+        QObject(parent),
+        enabled(false),
+        painting(false),
+        composing(false),
+        paintTrace(-1)
+    {
+        for(int s = 0; s < NUMBER_OF_STAGES; ++s)
+        {
+            samples[s].assign(WINDOW,0.0f);
+            first[s] = 0;
+            count[s] = 0;
+        }
+    }
+
+    void attach(QOpenGLWidget * viewport)
+    {
+        viewport->installEventFilter(this);
+        QObject::connect(viewport,SIGNAL(aboutToCompose()),this,SLOT(onAboutToCompose()));
+        QObject::connect(viewport,SIGNAL(frameSwapped()),this,SLOT(onFrameSwapped()));
+    }
+
+    bool isEnabled() const
+    {
+        return enabled;
+    }
+
+    bool isTimed(int stage) const
+    {
+        return enabled || stage == STAGE_LOAD;
+    }
+
+    void setEnabled(bool e)
+    {
+        enabled = e;
+        painting = false;
+        composing = false;
+    }
+
+    void record(int stage, clock::duration d)
+    {
+        const float us = std::chrono::duration<float,std::micro>(d).count();
+        if(count[stage] < WINDOW)
+        {
+            samples[stage][(first[stage]+count[stage]) % WINDOW] = us;
+            ++count[stage];
+        }
+        else
+        {
+            samples[stage][first[stage]] = us;
+            first[stage] = (first[stage]+1) % WINDOW;
+        }
+    }
+
+    void reset()
+    {
+        for(int s = 0; s < NUMBER_OF_STAGES; ++s)
+        {
+            if(s != STAGE_LOAD)
+            {
+                first[s] = 0;
+                count[s] = 0;
+            }
+        }
+    }
+
+    summary getSummary(int stage) const
+    {
+        summary r;
+        r.p50 = r.p99 = r.max = 0.0f;
+        r.count = count[stage];
+        std::fill(r.buckets,r.buckets+BUCKETS,0);
+        if(r.count == 0)
+        {
+            return r;
+        }
+        sorted.assign(samples[stage].begin(),samples[stage].begin()+r.count);
+        for(int i = 0; i < r.count; ++i)
+        {
+            int b = 0;
+            for(float v = sorted[i]; v >= 2.0f && b < BUCKETS-1; v *= 0.5f)
+            {
+                ++b;
+            }
+            ++r.buckets[b];
+        }
+        std::sort(sorted.begin(),sorted.end());
+        r.p50 = sorted[(r.count-1)/2];
+        r.p99 = sorted[((r.count-1)*99)/100];
+        r.max = sorted.back();
+        return r;
+    }
+
+protected:
+    bool eventFilter(QObject * watched, QEvent * event)
+    {
+        if(event->type() == QEvent::Paint)
+        {
+            if(enabled)
+            {
+                paintStart = clock::now();
+                painting = true;
+            }
+            if(traceRecorder::isRecording() && paintTrace < 0)
+            {
+                paintTrace = traceRecorder::begin("paint");
+            }
+        }
+        return QObject::eventFilter(watched,event);
+    }
+
+private slots:
+    void onAboutToCompose()
+    {
+        if(paintTrace >= 0)
+        {
+            traceRecorder::end("paint",paintTrace);
+            paintTrace = -1;
+        }
+        if(!enabled)
+        {
+            return;
+        }
+        clock::time_point now = clock::now();
+        if(painting)
+        {
+            record(STAGE_PAINT,now-paintStart);
+            painting = false;
+        }
+        composeStart = now;
+        composing = true;
+    }
+
+    void onFrameSwapped()
+    {
+        if(enabled && composing)
+        {
+            record(STAGE_SWAP,clock::now()-composeStart);
+            composing = false;
+        }
+    }
+
+private:
+    bool enabled;
+    bool painting;
+    bool composing;
+    int paintTrace;         // Recording of the open paint event, -1 if there is none
+    clock::time_point paintStart;
+    clock::time_point composeStart;
+    std::vector<float> samples[NUMBER_OF_STAGES];
+    int first[NUMBER_OF_STAGES];
+    int count[NUMBER_OF_STAGES];
+    mutable std::vector<float> sorted;
+};
+
+// Times the enclosing scope into a stage of the profiler, a null or disabled profiler costs a branch
+class scopedStageTimer
+{
+public:
+    scopedStageTimer(frameProfiler * p, int stage) :
+        profiler(p && p->isTimed(stage) ? p : nullptr),
+        stage(stage)
+    {
+        if(profiler)
+        {
+            start = frameProfiler::clock::now();
+        }
+    }
+
+    ~scopedStageTimer()
+    {
+        if(profiler)
+        {
+            profiler->record(stage,frameProfiler::clock::now()-start);
+        }
+    }
+
+private:
+    frameProfiler * profiler;
+    int stage;
+    frameProfiler::clock::time_point start;
+};
+
+// p50, p99 and max of every stage with a small log2 histogram, drawn over the top left corner
+// of the view. Mouse events go through to the view.
+class profilerOverlay : public QWidget
+{
+public:
+    profilerOverlay(const frameProfiler * profiler, QWidget * parent) :
+        QWidget(parent),
+        profiler(profiler)
+    {
+        setAttribute(Qt::WA_TransparentForMouseEvents);
+        setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+        const int lineHeight = fontMetrics().height();
+        resize(fontMetrics().horizontalAdvance("interpolation  p50 00000.0  p99 00000.0  max 00000.0 us ") + BUCKETS_WIDTH + 12,
+               lineHeight*(NUMBER_OF_STAGES+1) + 8);
+    }
+
+protected:
+    void paintEvent(QPaintEvent * /*event*/)
+    {
+        QPainter painter(this);
+        painter.fillRect(rect(),QColor(0,0,0,160));
+        painter.setPen(Qt::white);
+        const int lineHeight = fontMetrics().height();
+        const int textWidth = width() - BUCKETS_WIDTH - 12;
+        painter.drawText(QPoint(6,lineHeight),QString("last %1 frames").arg(int(frameProfiler::WINDOW)));
+        for(int s = 0; s < NUMBER_OF_STAGES; ++s)
+        {
+            frameProfiler::summary r = profiler->getSummary(s);
+            const int baseline = lineHeight*(s+2);
+            painter.setPen(Qt::white);
+            painter.drawText(QPoint(6,baseline),QString("%1 p50 %2  p99 %3  max %4 us")
+                             .arg(getStageName(s),-14)
+                             .arg(r.p50,7,'f',1).arg(r.p99,7,'f',1).arg(r.max,7,'f',1));
+            if(r.count == 0)
+            {
+                continue;
+            }
+            // One bar per power of two, scaled to the fullest bucket
+            const int fullest = *std::max_element(r.buckets,r.buckets+frameProfiler::BUCKETS);
+            const int barWidth = BUCKETS_WIDTH/frameProfiler::BUCKETS;
+            for(int b = 0; b < frameProfiler::BUCKETS; ++b)
+            {
+                const int h = (r.buckets[b]*(lineHeight-2))/fullest;
+                painter.fillRect(textWidth + 6 + b*barWidth, baseline-h, barWidth-1, h, QColor(120,200,255));
+            }
+        }
+    }
+
+private:
+    enum { BUCKETS_WIDTH = 96 };
+    const frameProfiler * profiler;
+};
+
+#endif // FRAMEPROFILER_H
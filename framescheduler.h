@@ -0,0 +1,142 @@
+#ifndef FRAMESCHEDULER_H
+#define FRAMESCHEDULER_H
+
+#include <QObject>
+#include <QTimer>
+#include <QOpenGLWidget>
+#include <chrono>
+#include <cmath>
+
+// Drives the refresh loop. Frames are started right after the viewport has swapped buffers when
+// that is close enough to the target period, so work lines up with the display refresh. A precise
+// timer covers the case where nothing was repainted and no swap will come. All timing is done with
+// steady_clock, and a frame that arrives more than 1.5 periods late counts the missed ones as dropped.
+class FrameScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    typedef std::chrono::steady_clock clock;
+
+    FrameScheduler(float targetRate, QObject * parent = 0) :
+        QObject(parent),
+        timer(),
+        running(false),
+        frameCount(0),
+        droppedFrames(0),
+        lastFrameSeconds(0.0)
+    {
+        setTargetRate(targetRate);
+        timer.setSingleShot(true);
+        timer.setTimerType(Qt::PreciseTimer);
+        QObject::connect(&timer,SIGNAL(timeout()),this,SLOT(tick()));
+    }
+
+    // Ticks early when the viewport swaps, so the scheduler follows the display instead of the timer
+    void attach(QOpenGLWidget * viewport)
+    {
+        QObject::connect(viewport,SIGNAL(frameSwapped()),this,SLOT(onFrameSwapped()));
+    }
+
+    void setTargetRate(float hz)
+    {
+        if(hz < 1.0f)
+        {
+            hz = 1.0f;
+        }
+        period = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1.0/double(hz)));
+        if(running)
+        {
+            scheduleNext();
+        }
+    }
+    float getTargetRate() const
+    {
+        return float(1.0/std::chrono::duration<double>(period).count());
+    }
+
+    void start()
+    {
+        running = true;
+        lastFrame = clock::now();
+        timer.start(0);
+    }
+    void stop()
+    {
+        running = false;
+        timer.stop();
+    }
+
+    quint64 getFrameCount() const
+    {
+        return frameCount;
+    }
+    quint64 getDroppedFrames() const
+    {
+        return droppedFrames;
+    }
+    void resetStatistics()
+    {
+        frameCount = 0;
+        droppedFrames = 0;
+    }
+    // Time between the two most recent frames
+    double getLastFrameSeconds() const
+    {
+        return lastFrameSeconds;
+    }
+
+signals:
+    void frame();
+
+private slots:
+    void tick()
+    {
+        if(!running)
+        {
+            return;
+        }
+        timer.stop();
+        clock::time_point now = clock::now();
+        clock::duration sinceLast = now-lastFrame;
+        lastFrame = now;
+        lastFrameSeconds = std::chrono::duration<double>(sinceLast).count();
+        ++frameCount;
+        if(sinceLast > period + period/2)
+        {
+            droppedFrames += quint64(std::floor(double(sinceLast.count())/double(period.count()) - 0.5));
+        }
+
+        emit frame();
+
+        scheduleNext();
+    }
+
+    void onFrameSwapped()
+    {
+        // A swap slightly ahead of the timer is taken as the start of the next frame
+        if(running && clock::now()-lastFrame >= period - period/8)
+        {
+            tick();
+        }
+    }
+
+private:
+    void scheduleNext()
+    {
+        // Never recurses, an overrun frame simply makes the next one start from the event loop
+        clock::duration remaining = period - (clock::now()-lastFrame);
+        long long ms = std::chrono::duration_cast<std::chrono::milliseconds>(remaining).count();
+        timer.start(ms > 0 ? int(ms) : 0);
+    }
+
+    QTimer timer;
+    bool running;
+    clock::duration period;
+    clock::time_point lastFrame;
+    quint64 frameCount;
+    quint64 droppedFrames;
+    double lastFrameSeconds;
+};
+
+#endif // FRAMESCHEDULER_H
@@ -6,83 +6,178 @@
 #include <QGraphicsPolygonItem>
 #include <QPen>
 #include <QTransform>
+#include <QPainter>
+#include <QStyleOptionGraphicsItem>
+#include <QStaticText>
+#include <QPainterPath>
+#include <cmath>
+#include <vector>
+#include <algorithm>
 #include "dimensions.h"
+#include "kinematics.h"
+#include "simdkernels.h"
 
-#define SCALE_ALL_FACTOR 400
+// Moves an item only if the change would be visible. setPos and setRotation invalidate the
+// scene index and schedule a repaint even for sub-pixel changes. The threshold is in scene
+// units, radius is the distance from the item origin to its farthest point.
+inline bool updateItemPose(QGraphicsItem* item, qreal x, qreal y, qreal rotation, qreal threshold, qreal radius)
+{
+    const QPointF p = item->pos();
+    const qreal rotationShift = std::abs(rotation - item->rotation())*3.1415/180.0*radius;
+    if(std::abs(p.x()-x) < threshold && std::abs(p.y()-y) < threshold && rotationShift < threshold)
+    {
+        return false;
+    }
+    item->setPos(x,y);
+    item->setRotation(rotation);
+    return true;
+}
+
+// Maps a value range onto SIZE precomputed brushes, from blue at the low end through green to red.
+// Looking up a colour is an index computation, no brushes are created per frame.
+class colorLookupTable
+{
+public:
+    enum { SIZE = 256 };
+
+    colorLookupTable() :
+        hasRange(false),
+        minValue(0.0f),
+        maxValue(0.0f),
+        invRange(0.0f)
+    {
+        for(int i = 0; i < SIZE; ++i)
+        {
+            brushes[i] = QBrush(QColor::fromHsv(240 - (240*i)/(SIZE-1),255,230),Qt::SolidPattern);
+        }
+    }
+
+    void setRange(float lo, float hi)
+    {
+        hasRange = true;
+        minValue = lo;
+        maxValue = hi;
+        invRange = hi > lo ? float(SIZE-1)/(hi-lo) : 0.0f;
+    }
+
+    void clearRange()
+    {
+        hasRange = false;
+        minValue = 0.0f;
+        maxValue = 0.0f;
+        invRange = 0.0f;
+    }
+
+    // Widens the range to include v, for sources where the whole run isn't known up front
+    void include(float v)
+    {
+        if(!hasRange)
+        {
+            setRange(v,v);
+        }
+        else if(v < minValue || v > maxValue)
+        {
+            setRange(std::min(v,minValue),std::max(v,maxValue));
+        }
+    }
+
+    int index(float v) const
+    {
+        int i = int((v-minValue)*invRange);
+        return std::max(0,std::min(int(SIZE-1),i));
+    }
+
+    const QBrush & brush(int i) const
+    {
+        return brushes[i];
+    }
+
+private:
+    QBrush brushes[SIZE];
+    bool hasRange;
+    float minValue;
+    float maxValue;
+    float invRange;
+};
+
+// How much of the snake is painted, from the on-screen length of a segment
+enum snakeDetail
+{
+    SNAKE_DETAIL_LINE,      // One thick polyline through the segment centres
+    SNAKE_DETAIL_BODIES,    // Filled bodies without outlines, joints or centres of mass
+    SNAKE_DETAIL_FULL
+};
+
+// pixelsPerUnit is the scale of the view, e.g. from QStyleOptionGraphicsItem::levelOfDetailFromTransform
+inline snakeDetail getSnakeDetail(qreal pixelsPerUnit)
+{
+    typedef robot_dimensions<SCALE_ALL_FACTOR> RD;
+    // Below these segment lengths in pixels the outlines and then the bodies turn to mush
+    const qreal bodyPixels = 6.0;
+    const qreal fullPixels = 24.0;
+    const qreal length = pixelsPerUnit*(RD::segmentMCtoForwardJointConnection(0)+RD::segmentMCtoBackwardJointConnection(0));
+    if(length < bodyPixels)
+    {
+        return SNAKE_DETAIL_LINE;
+    }
+    return length < fullPixels ? SNAKE_DETAIL_BODIES : SNAKE_DETAIL_FULL;
+}
 
+// Body, centre of mass and joints of one segment, painted directly. The body is green unless a
+// heat colour from a colorLookupTable is set.
 class GraphicsSegmentItem : public QGraphicsItem
 {
 public:
     GraphicsSegmentItem(const int segment, const int numSegments) :
-        m_segment(segment)
+        m_segment(segment),
+        hasFrontJoint(segment != 0),
+        hasBackJoint(segment != numSegments-1),
+        heatmap(nullptr),
+        heatIndex(-1)
     {
         typedef robot_dimensions<SCALE_ALL_FACTOR> RD;
         typedef CenterOfMass_dimensions<SCALE_ALL_FACTOR> CMD;
-        QGraphicsRectItem * segmentRect = new QGraphicsRectItem(-RD::segmentMCtoEdgeBackward(m_segment),
-                                                                -RD::segmentMCtoEdgeLeft(m_segment),
-                                                                RD::segmentMCtoEdgeBackward(m_segment)+RD::segmentMCtoEdgeForward(m_segment),
-                                                                RD::segmentMCtoEdgeLeft(m_segment)+RD::segmentMCtoEdgeRight(m_segment));
-        QPen segmentPen;
-        segmentPen.setStyle(Qt::SolidLine);
-        segmentPen.setBrush(Qt::black);
-        segmentRect->setPen(segmentPen);
-        QBrush segmentBrush;
-        segmentBrush.setStyle(Qt::SolidPattern);
-        segmentBrush.setColor(Qt::green);
-        segmentRect->setBrush(segmentBrush);
-        segmentRect->setParentItem(this);
-
-        QGraphicsEllipseItem * cmCircle = new QGraphicsEllipseItem(-CMD::circleRadius(m_segment),
-                                                                   -CMD::circleRadius(m_segment),
-                                                                   2*CMD::circleRadius(m_segment),
-                                                                   2*CMD::circleRadius(m_segment));
-        QPen cmPen;
+        segmentRect = QRectF(-RD::segmentMCtoEdgeBackward(m_segment),
+                             -RD::segmentMCtoEdgeLeft(m_segment),
+                             RD::segmentMCtoEdgeBackward(m_segment)+RD::segmentMCtoEdgeForward(m_segment),
+                             RD::segmentMCtoEdgeLeft(m_segment)+RD::segmentMCtoEdgeRight(m_segment));
+        cmCircle = QRectF(-CMD::circleRadius(m_segment),
+                          -CMD::circleRadius(m_segment),
+                          2*CMD::circleRadius(m_segment),
+                          2*CMD::circleRadius(m_segment));
+        // the segment is not in the front, ie does have a joint at the front
+        jointFront = QRectF(RD::segmentMCtoForwardJointBegin(m_segment),
+                            -0.5f*RD::jointForwardWidth(m_segment),
+                            RD::segmentMCtoForwardJointEnd(m_segment)-RD::segmentMCtoForwardJointBegin(m_segment),
+                            RD::jointForwardWidth(m_segment));
+        // the segment is not the last one, ie does have a joint at the back
+        jointBack = QRectF(-RD::segmentMCtoBackwardJointEnd(m_segment),
+                           -0.5f*RD::jointBackwardWidth(m_segment),
+                           RD::segmentMCtoBackwardJointEnd(m_segment)-RD::segmentMCtoBackwardJointBegin(m_segment),
+                           RD::jointBackwardWidth(m_segment));
+
+        outlinePen.setStyle(Qt::SolidLine);
+        outlinePen.setBrush(Qt::black);
         cmPen.setStyle(Qt::SolidLine);
         cmPen.setBrush(Qt::red);
-        cmCircle->setPen(cmPen);
-        QBrush cmBrush;
-        cmBrush.setStyle(Qt::SolidPattern);
-        cmBrush.setColor(Qt::red);
-        cmCircle->setBrush(cmBrush);
-        cmCircle->setParentItem(this);
-
-        if(segment != 0)
-        {
-            // the segment is not in the front, ie does have a joint at the front
-            QGraphicsRectItem * jointFront = new QGraphicsRectItem(RD::segmentMCtoForwardJointBegin(m_segment),
-                                                                  -0.5f*RD::jointForwardWidth(m_segment),
-                                                                  RD::segmentMCtoForwardJointEnd(m_segment)-RD::segmentMCtoForwardJointBegin(m_segment),
-                                                                  RD::jointForwardWidth(m_segment));
-            QPen frontPen;
-            frontPen.setStyle(Qt::SolidLine);
-            frontPen.setBrush(Qt::black);
-            jointFront->setPen(frontPen);
-            QBrush frontBrush;
-            frontBrush.setStyle(Qt::SolidPattern);
-            frontBrush.setColor(Qt::white);
-            jointFront->setBrush(frontBrush);
-            jointFront->setParentItem(this);
-        }
-        if(segment != numSegments-1)
-        {
-            // the segment is not the last one, ie does have a joint at the back
-            QGraphicsRectItem * jointBack = new QGraphicsRectItem(-RD::segmentMCtoBackwardJointEnd(m_segment),
-                                                                  -0.5f*RD::jointBackwardWidth(m_segment),
-                                                                  RD::segmentMCtoBackwardJointEnd(m_segment)-RD::segmentMCtoBackwardJointBegin(m_segment),
-                                                                  RD::jointBackwardWidth(m_segment));
-            QPen backPen;
-            backPen.setStyle(Qt::SolidLine);
-            backPen.setBrush(Qt::black);
-            jointBack->setPen(backPen);
-            QBrush backBrush;
-            backBrush.setStyle(Qt::SolidPattern);
-            backBrush.setColor(Qt::blue);
-            jointBack->setBrush(backBrush);
-            jointBack->setParentItem(this);
-        }
+        segmentBrush = QBrush(Qt::green,Qt::SolidPattern);
+        cmBrush = QBrush(Qt::red,Qt::SolidPattern);
+        frontBrush = QBrush(Qt::white,Qt::SolidPattern);
+        backBrush = QBrush(Qt::blue,Qt::SolidPattern);
     }
     ~GraphicsSegmentItem(){}
 
+    // index < 0 goes back to the plain body colour
+    void setHeatIndex(const colorLookupTable * table, int index)
+    {
+        if(table != heatmap || index != heatIndex)
+        {
+            heatmap = table;
+            heatIndex = index;
+            update();
+        }
+    }
+
     QRectF boundingRect() const
     {
         typedef robot_dimensions<SCALE_ALL_FACTOR> RD;
@@ -92,20 +187,115 @@ public:
                       RD::segmentMCtoEdgeLeft(m_segment)+RD::segmentMCtoEdgeRight(m_segment));
     }
 
-    void paint(QPainter* /*painter*/, const QStyleOptionGraphicsItem* /*option*/, QWidget* /*widget*/)
-
+    void paint(QPainter* painter, const QStyleOptionGraphicsItem* /*option*/, QWidget* /*widget*/)
     {
+        const snakeDetail detail = getSnakeDetail(QStyleOptionGraphicsItem::levelOfDetailFromTransform(painter->worldTransform()));
+        if(detail == SNAKE_DETAIL_LINE)
+        {
+            // GraphicsSnakeLineItem paints the whole snake
+            return;
+        }
+        painter->setPen(detail == SNAKE_DETAIL_FULL ? outlinePen : QPen(Qt::NoPen));
+        painter->setBrush(heatmap && heatIndex >= 0 ? heatmap->brush(heatIndex) : segmentBrush);
+        painter->drawRect(segmentRect);
+        if(detail != SNAKE_DETAIL_FULL)
+        {
+            return;
+        }
+        if(hasFrontJoint)
+        {
+            painter->setBrush(frontBrush);
+            painter->drawRect(jointFront);
+        }
+        if(hasBackJoint)
+        {
+            painter->setBrush(backBrush);
+            painter->drawRect(jointBack);
+        }
+        painter->setPen(cmPen);
+        painter->setBrush(cmBrush);
+        painter->drawEllipse(cmCircle);
     }
 
 
 private:
     const int m_segment;
+    const bool hasFrontJoint;
+    const bool hasBackJoint;
+    const colorLookupTable * heatmap;
+    int heatIndex;
+    QRectF segmentRect;
+    QRectF cmCircle;
+    QRectF jointFront;
+    QRectF jointBack;
+    QPen outlinePen;
+    QPen cmPen;
+    QBrush segmentBrush;
+    QBrush cmBrush;
+    QBrush frontBrush;
+    QBrush backBrush;
+};
+
+// The snake as one polyline through the segment centres, as wide as a segment. Only painted while
+// the segments are too small on screen to paint themselves, see getSnakeDetail.
+class GraphicsSnakeLineItem : public QGraphicsItem
+{
+private:
+    QPolygonF line;
+    QRectF bounds;
+    QPen pen;
+public:
+    GraphicsSnakeLineItem(const QColor & color)
+    {
+        typedef robot_dimensions<SCALE_ALL_FACTOR> RD;
+        pen.setStyle(Qt::SolidLine);
+        pen.setColor(color);
+        pen.setWidthF(RD::segmentMCtoEdgeLeft(0)+RD::segmentMCtoEdgeRight(0));
+        pen.setCapStyle(Qt::RoundCap);
+        pen.setJoinStyle(Qt::RoundJoin);
+    }
+
+    void setPoses(const std::vector<segmentPose> & poses)
+    {
+        line.resize(int(poses.size()));
+        for(size_t i = 0; i < poses.size(); ++i)
+        {
+            line[int(i)] = QPointF(poses[i].x,poses[i].y);
+        }
+        const qreal w = 0.5*pen.widthF();
+        prepareGeometryChange();
+        bounds = line.boundingRect().adjusted(-w,-w,w,w);
+    }
+
+    QRectF boundingRect() const
+    {
+        return bounds;
+    }
+
+    void paint(QPainter* painter, const QStyleOptionGraphicsItem* /*option*/, QWidget* /*widget*/)
+    {
+        if(getSnakeDetail(QStyleOptionGraphicsItem::levelOfDetailFromTransform(painter->worldTransform())) != SNAKE_DETAIL_LINE)
+        {
+            return;
+        }
+        painter->setPen(pen);
+        painter->drawPolyline(line);
+    }
 };
 
 class GraphicsArrowItem : public QGraphicsItem
 {
+private:
+    float lastX;
+    float lastY;
+    bool lastShow;
+    bool applied;
 public:
-    GraphicsArrowItem(int color)
+    GraphicsArrowItem(int color) :
+        lastX(0.0f),
+        lastY(0.0f),
+        lastShow(false),
+        applied(false)
     {
         typedef Arrow_dimensions<SCALE_ALL_FACTOR> AD;
         QGraphicsRectItem * arrowBaseRect = new QGraphicsRectItem(0.0f,-AD::arrowBreadth()*0.5f,
@@ -147,8 +337,20 @@ public:
     {
     }
 
-    void modify(float x, float y, bool show)
+    // threshold is the smallest movement of the arrow tip, in scene units, that is applied
+    void modify(float x, float y, bool show, float threshold = 0.0f)
     {
+        typedef Arrow_dimensions<SCALE_ALL_FACTOR> AD;
+        if(applied && show == lastShow &&
+           std::abs(x-lastX)*AD::arrowLength() < threshold &&
+           std::abs(y-lastY)*AD::arrowLength() < threshold)
+        {
+            return;
+        }
+        applied = true;
+        lastX = x;
+        lastY = y;
+        lastShow = show;
         qreal len = std::sqrt(x*x+y*y);
         if(len > 0.1f)
         {
@@ -166,118 +368,612 @@ public:
     }
 };
 
+// Torque of every joint as a bar chart, optionally with a sparkline of the recent history of each
+// joint underneath. Everything is painted by this one item from plain float arrays, the history
+// is a fixed ring buffer of the last HISTORY_LENGTH frames.
 class GraphicsTorqueDisplay : public QGraphicsItem
 {
+public:
+    enum { HISTORY_LENGTH = 128 };
+
 private:
     int numJoints;
-    QVector<QGraphicsRectItem*> meters;
     const float itemheight;
     const float meterwidth;
     const float length;
     const float scale;
+    float xstart;
+    float ystart;
+    std::vector<float> meterX;
+    std::vector<float> values;
+    std::vector<float> history;
+    int historyFirst;
+    int historyCount;
+    bool showHistory;
+    QPen meterPen;
+    QBrush meterBrush;
+    QPen gridPen;
+    QPen sparkPen;
+    QStaticText unitLabel;
+    std::vector<QStaticText> scaleLabels;
+    QPolygonF sparkline;
+
+    float sparklineTop() const
+    {
+        return itemheight*0.5f + itemheight*0.1f;
+    }
+    float sparklineHeight() const
+    {
+        return itemheight*0.5f;
+    }
+
 public:
     GraphicsTorqueDisplay(float scale, float length, int numberOfJoints, int torqueColor) :
-        numJoints(numberOfJoints),
+        numJoints(std::max(0,numberOfJoints)),
         itemheight(0.2f*SCALE_ALL_FACTOR),
         meterwidth(0.06f*SCALE_ALL_FACTOR),
         length(length),
-        scale(scale)
+        scale(scale),
+        xstart(-length*0.5f),
+        ystart(-itemheight*0.5f),
+        meterX(numJoints),
+        values(numJoints,0.0f),
+        history(numJoints*HISTORY_LENGTH,0.0f),
+        historyFirst(0),
+        historyCount(0),
+        showHistory(false),
+        unitLabel("nm")
     {
-        float xstart = -length*0.5f;
-        float ystart = -itemheight*0.5f;
+        // A frame without sections has no joints
+        float freeSpace = length - meterwidth*numJoints;
+        // Choose indentation such that it is 0.5 of the spacing between the meters
+        float spacing = freeSpace / float(std::max(1,numJoints));
+        float indentation = spacing/2;
+        for(int i = 0; i < numJoints; ++i)
+        {
+            meterX[i] = xstart + indentation + i*(meterwidth+spacing);
+        }
 
-        QGraphicsTextItem * nmLabel = new QGraphicsTextItem("nm");
-        nmLabel->setPos(xstart-nmLabel->boundingRect().height()/2,
-                        ystart-nmLabel->boundingRect().height());
-        nmLabel->setParentItem(this);
-        QGraphicsLineItem * scaleLine = new QGraphicsLineItem(xstart,ystart,xstart,ystart+itemheight);
-        QPen scaleLinePen;
-        scaleLinePen.setStyle(Qt::SolidLine);
-        scaleLine->setPen(scaleLinePen);
-        scaleLine->setParentItem(this);
+        meterPen.setStyle(Qt::SolidLine);
+        meterPen.setBrush(Qt::black);
+        meterBrush.setStyle(Qt::SolidPattern);
+        meterBrush.setColor(Qt::GlobalColor(torqueColor));
+        gridPen.setStyle(Qt::SolidLine);
+        sparkPen.setStyle(Qt::SolidLine);
+        sparkPen.setCosmetic(true);
+        sparkPen.setBrush(Qt::GlobalColor(torqueColor));
 
+        unitLabel.prepare();
+        for(int i = -2; i < 3; ++i)
+        {
+            QStaticText label(QString::number(-scale*float(i)/2.0f,'g',3));
+            label.prepare();
+            scaleLabels.push_back(label);
+        }
+        sparkline.reserve(HISTORY_LENGTH);
+    }
 
-        float freeSpace = length - meterwidth*numberOfJoints;
-        // Choose indentation such that it is 0.5 of the spacing between the meters
-        float spacing = freeSpace / float(numberOfJoints);
-        float indentation = spacing/2;
+    // Sets the torque of all joints. Nothing is repainted unless a bar changes by at least
+    // threshold scene units.
+    void setTorques(const float * torques, int n, float threshold = 0.0f)
+    {
+        n = std::max(0,std::min(n,numJoints));
+        bool changed = false;
+        for(int i = 0; i < n; ++i)
+        {
+            if(std::abs(torques[i]-values[i])/scale*itemheight/2.0f >= threshold)
+            {
+                changed = true;
+            }
+        }
+        if(!changed && !showHistory)
+        {
+            return;
+        }
+        std::copy(torques,torques+n,values.begin());
+        update();
+    }
 
-        for(int i = 0; i < numberOfJoints; ++i)
-        {
-            float meterXStart = xstart + indentation + i*(meterwidth+spacing);
-            float meterYStart = 0.0f;
-            float meterWidth = meterwidth;
-            float meterHeight = 0.0f;
-            QGraphicsRectItem * m = new QGraphicsRectItem(meterXStart,meterYStart,meterWidth,meterHeight);
-            QPen mPen;
-            mPen.setStyle(Qt::SolidLine);
-            mPen.setBrush(Qt::black);
-            m->setPen(mPen);
-            QBrush mBrush;
-            mBrush.setStyle(Qt::SolidPattern);
-            mBrush.setColor(Qt::GlobalColor(torqueColor));
-            m->setBrush(mBrush);
-            meters.push_back(m);
-            m->setParentItem(this);
+    // Appends the current torques to the history, overwriting the oldest frame when it is full
+    void pushHistory()
+    {
+        int slot;
+        if(historyCount == HISTORY_LENGTH)
+        {
+            slot = historyFirst;
+            historyFirst = (historyFirst+1) % HISTORY_LENGTH;
+        }
+        else
+        {
+            slot = (historyFirst+historyCount) % HISTORY_LENGTH;
+            ++historyCount;
+        }
+        std::copy(values.begin(),values.end(),history.begin()+slot*numJoints);
+        if(showHistory)
+        {
+            update();
+        }
+    }
+
+    void clearHistory()
+    {
+        historyFirst = 0;
+        historyCount = 0;
+        update();
+    }
+
+    void setShowHistory(bool show)
+    {
+        if(show != showHistory)
+        {
+            prepareGeometryChange();
+            showHistory = show;
         }
+    }
+
+    QRectF boundingRect() const
+    {
+        const float labelMargin = itemheight*0.5f;
+        const float bottom = showHistory ? sparklineTop()+sparklineHeight() : itemheight*0.5f;
+        return QRectF(-length*0.5f - labelMargin,
+                      -itemheight*0.5f - labelMargin,
+                      length + labelMargin,
+                      bottom + itemheight*0.5f + labelMargin);
+    }
 
+    void paint(QPainter* painter, const QStyleOptionGraphicsItem* /*option*/, QWidget* /*widget*/)
+    {
+        // Scale and grid
+        painter->setPen(gridPen);
+        painter->drawLine(QPointF(xstart,ystart),QPointF(xstart,ystart+itemheight));
+        painter->drawStaticText(QPointF(xstart-unitLabel.size().height()/2,ystart-unitLabel.size().height()),unitLabel);
         for(int i = -2; i < 3; ++i)
         {
             float posY = itemheight*float(i)/4.0f;
-            QGraphicsLineItem * line = new QGraphicsLineItem(xstart,posY,length*0.5f,posY);
-            QPen linePen;
-            scaleLinePen.setStyle(Qt::DashLine);
-            line->setPen(linePen);
-            line->setParentItem(this);
+            painter->drawLine(QPointF(xstart,posY),QPointF(length*0.5f,posY));
+            const QStaticText & label = scaleLabels[i+2];
+            painter->drawStaticText(QPointF(xstart-label.size().width(),posY-label.size().height()/2),label);
+        }
+
+        // Bars, growing up for positive torque and down for negative torque
+        painter->setPen(meterPen);
+        painter->setBrush(meterBrush);
+        for(int i = 0; i < numJoints; ++i)
+        {
+            float meterHeight = -(values[i]/scale)*itemheight/2.0f;
+            painter->drawRect(QRectF(meterX[i],0.0f,meterwidth,meterHeight).normalized());
+        }
 
-            QGraphicsTextItem * scaleLabel = new QGraphicsTextItem(QString::number(-scale*float(i)/2.0f,'g',3));
-            scaleLabel->setPos(xstart-scaleLabel->boundingRect().width(),
-                               posY-scaleLabel->boundingRect().height()/2);
-            scaleLabel->setParentItem(this);
+        if(!showHistory || historyCount < 2)
+        {
+            return;
+        }
+        // One sparkline per joint under its bar, oldest frame to the left
+        const float top = sparklineTop();
+        const float height = sparklineHeight();
+        const float mid = top + height*0.5f;
+        const float spacing = numJoints > 1 ? meterX[1]-meterX[0] : length;
+        const float cellWidth = spacing*0.9f;
+        const float step = cellWidth/float(HISTORY_LENGTH-1);
+        painter->setBrush(Qt::NoBrush);
+        for(int j = 0; j < numJoints; ++j)
+        {
+            const float left = meterX[j] + meterwidth*0.5f - cellWidth*0.5f;
+            painter->setPen(gridPen);
+            painter->drawLine(QPointF(left,mid),QPointF(left+cellWidth,mid));
+            sparkline.resize(historyCount);
+            for(int k = 0; k < historyCount; ++k)
+            {
+                const float v = history[((historyFirst+k) % HISTORY_LENGTH)*numJoints + j];
+                float y = mid - (v/scale)*height*0.5f;
+                y = std::max(top,std::min(top+height,y));
+                sparkline[k] = QPointF(left + (HISTORY_LENGTH-historyCount+k)*step, y);
+            }
+            painter->setPen(sparkPen);
+            painter->drawPolyline(sparkline);
         }
     }
+};
 
-    void modify(int jointIndex, float value)
+// Arrows for a whole per-segment vector field, e.g. all resultant forces, painted with one call.
+// Lengths and directions are computed for all segments in one pass over plain float arrays. The
+// direction is kept as a unit vector instead of an angle, so no atan2 or QTransform is needed per
+// arrow. With a stride k only every k-th segment gets an arrow, for use when zoomed out.
+class GraphicsArrowFieldItem : public QGraphicsItem
+{
+private:
+    std::vector<float> originX;
+    std::vector<float> originY;
+    std::vector<float> valueX;
+    std::vector<float> valueY;
+    std::vector<float> len;
+    std::vector<float> dirX;
+    std::vector<float> dirY;
+    int stride;
+    bool applied;
+    QPainterPath path;
+    QRectF bounds;
+    QPen pen;
+    QBrush brush;
+    QPolygonF arrow;
+
+    void rebuild()
     {
-        float xstart = -length*0.5f;
-        float freeSpace = length - meterwidth*numJoints;
-        // Choose indentation such that it is 0.5 of the spacing between the meters
-        float spacing = freeSpace / float(numJoints);
-        float indentation = spacing/2;
-        float meterXStart = xstart+jointIndex*(meterwidth+spacing) + indentation;
-        float meterYStart;
-        float meterHeight;
-        if(value > 0.0f)
+        typedef Arrow_dimensions<SCALE_ALL_FACTOR> AD;
+        const int n = int(len.size());
+        // Magnitude and unit direction of every arrow in one SIMD pass
+        getSimdKernels().arrowMagnitudes(valueX.data(),valueY.data(),len.data(),dirX.data(),dirY.data(),n);
+
+        // Shaft and head as one outline, only the length is scaled by the magnitude
+        const float halfBreadth = AD::arrowBreadth()*0.5f;
+        const float halfHead = AD::arrowHeadBreadth()*0.5f;
+        path = QPainterPath();
+        path.setFillRule(Qt::WindingFill);
+        for(int i = 0; i < n; i += stride)
+        {
+            if(len[i] <= 0.1f)
+            {
+                continue;
+            }
+            const float shaft = (AD::arrowLength()-AD::arrowHeadLength())*len[i];
+            const float tip = AD::arrowLength()*len[i];
+            const float u[7] = { 0.0f, shaft, shaft, tip, shaft, shaft, 0.0f };
+            const float v[7] = { -halfBreadth, -halfBreadth, -halfHead, 0.0f, halfHead, halfBreadth, halfBreadth };
+            for(int k = 0; k < 7; ++k)
+            {
+                arrow[k] = QPointF(originX[i] + u[k]*dirX[i] - v[k]*dirY[i],
+                                   originY[i] + u[k]*dirY[i] + v[k]*dirX[i]);
+            }
+            path.addPolygon(arrow);
+            path.closeSubpath();
+        }
+        prepareGeometryChange();
+        bounds = path.boundingRect();
+        update();
+    }
+
+public:
+    GraphicsArrowFieldItem(int color) :
+        stride(1),
+        applied(false),
+        arrow(7)
+    {
+        pen.setStyle(Qt::SolidLine);
+        pen.setWidth(1);
+        pen.setBrush(Qt::black);
+        brush.setStyle(Qt::SolidPattern);
+        brush.setColor(Qt::GlobalColor(color));
+    }
+
+    // Sets the field from arrays of n arrow origins and vector components. threshold is the smallest
+    // movement, in scene units, of an origin or arrow tip that causes the field to be rebuilt.
+    void setField(const std::vector<segmentPose> & origins, const float * x, const float * y, int n, int k, float threshold = 0.0f)
+    {
+        typedef Arrow_dimensions<SCALE_ALL_FACTOR> AD;
+        k = std::max(1,k);
+        bool changed = !applied || k != stride || int(len.size()) != n;
+        if(!changed)
+        {
+            float deviation = 0.0f;
+            for(int i = 0; i < n; ++i)
+            {
+                deviation = std::max(deviation,std::abs(origins[i].x-originX[i]));
+                deviation = std::max(deviation,std::abs(origins[i].y-originY[i]));
+                deviation = std::max(deviation,std::abs(x[i]-valueX[i])*AD::arrowLength());
+                deviation = std::max(deviation,std::abs(y[i]-valueY[i])*AD::arrowLength());
+            }
+            changed = deviation >= threshold;
+        }
+        if(!changed)
         {
-            meterYStart = -(value/scale)*itemheight/2.0f;
-            meterHeight = -meterYStart;
+            return;
         }
-        else if(value < 0.0f)
+        originX.resize(n);
+        originY.resize(n);
+        valueX.assign(x,x+n);
+        valueY.assign(y,y+n);
+        len.resize(n);
+        dirX.resize(n);
+        dirY.resize(n);
+        for(int i = 0; i < n; ++i)
         {
-            meterYStart = 0.0f;
-            meterHeight = -(value/scale)*itemheight/2.0f;
+            originX[i] = origins[i].x;
+            originY[i] = origins[i].y;
+        }
+        stride = k;
+        applied = true;
+        rebuild();
+    }
+
+    QRectF boundingRect() const
+    {
+        return bounds.adjusted(-1.0,-1.0,1.0,1.0);
+    }
+
+    void paint(QPainter* painter, const QStyleOptionGraphicsItem* /*option*/, QWidget* /*widget*/)
+    {
+        painter->setPen(pen);
+        painter->setBrush(brush);
+        painter->drawPath(path);
+    }
+};
+
+// Path of a point over time, kept in a fixed-capacity ring buffer and drawn as one polyline.
+// Points closer than a pixel to the previously drawn point are dropped while painting, so the
+// cost of a frame is bounded by the capacity no matter how long the run is.
+class GraphicsTrailItem : public QGraphicsItem
+{
+private:
+    std::vector<QPointF> ring;
+    int first;
+    int count;
+    QRectF bounds;
+    QPolygonF polyline;
+    QPen pen;
+
+    void include(const QPointF & p)
+    {
+        if(bounds.isNull())
+        {
+            prepareGeometryChange();
+            bounds = QRectF(p,QSizeF(0.0,0.0));
+        }
+        else if(!bounds.contains(p))
+        {
+            prepareGeometryChange();
+            bounds.setLeft(std::min(bounds.left(),p.x()));
+            bounds.setRight(std::max(bounds.right(),p.x()));
+            bounds.setTop(std::min(bounds.top(),p.y()));
+            bounds.setBottom(std::max(bounds.bottom(),p.y()));
+        }
+    }
+public:
+    GraphicsTrailItem(int capacity, int color) :
+        ring(capacity),
+        first(0),
+        count(0),
+        bounds()
+    {
+        polyline.reserve(capacity);
+        pen.setStyle(Qt::SolidLine);
+        pen.setCosmetic(true);
+        pen.setWidth(2);
+        pen.setBrush(Qt::GlobalColor(color));
+    }
+
+    int capacity() const
+    {
+        return int(ring.size());
+    }
+
+    int size() const
+    {
+        return count;
+    }
+
+    void clear()
+    {
+        prepareGeometryChange();
+        first = 0;
+        count = 0;
+        bounds = QRectF();
+    }
+
+    void push(float x, float y)
+    {
+        const QPointF p(x,y);
+        if(count == capacity())
+        {
+            // Overwrite the oldest point. The bounds are left as they are, they only shrink on clear()
+            ring[first] = p;
+            first = (first+1) % capacity();
         }
         else
         {
-            meterYStart = 0.0f;
-            meterHeight = 0.0f;
+            ring[(first+count) % capacity()] = p;
+            ++count;
+        }
+        include(p);
+        update();
+    }
+
+    // Adds a point before the oldest one, if there is room
+    void prepend(float x, float y)
+    {
+        if(count == capacity())
+        {
+            return;
         }
-        meters.at(jointIndex)->setRect(meterXStart,meterYStart,meterwidth,meterHeight);
+        const QPointF p(x,y);
+        first = (first+capacity()-1) % capacity();
+        ring[first] = p;
+        ++count;
+        include(p);
+        update();
+    }
+
+    // Drops the newest k points, the bounds only shrink on clear()
+    void truncate(int k)
+    {
+        count -= std::max(0,std::min(k,count));
+        update();
     }
 
     QRectF boundingRect() const
     {
-        return QRectF(-length*0.5f,
-                      -itemheight*0.5f,
-                      length,
-                      itemheight);
+        qreal margin = 2.0;
+        return bounds.adjusted(-margin,-margin,margin,margin);
     }
 
-    void paint(QPainter* /*painter*/, const QStyleOptionGraphicsItem* /*option*/, QWidget* /*widget*/)
+    void paint(QPainter* painter, const QStyleOptionGraphicsItem* option, QWidget* /*widget*/)
     {
+        if(count < 2)
+        {
+            return;
+        }
+        // Size of a pixel in item coordinates
+        const qreal lod = option->levelOfDetailFromTransform(painter->worldTransform());
+        const qreal pixel = lod > 0.0 ? 1.0/lod : 0.0;
+        polyline.resize(0);
+        QPointF last = ring[first];
+        polyline.push_back(last);
+        for(int i = 1; i < count; ++i)
+        {
+            const QPointF & p = ring[(first+i) % capacity()];
+            if(std::abs(p.x()-last.x()) >= pixel || std::abs(p.y()-last.y()) >= pixel || i == count-1)
+            {
+                polyline.push_back(p);
+                last = p;
+            }
+        }
+        painter->setPen(pen);
+        painter->setBrush(Qt::NoBrush);
+        painter->drawPolyline(polyline);
     }
 };
 
+// All robots of an ensemble painted by a single item, either on top of each other in world
+// coordinates or tiled in a grid where each robot is centred on its own centre of mass.
+class GraphicsEnsembleItem : public QGraphicsItem
+{
+private:
+    std::vector<std::vector<segmentPose> > poses;
+    std::vector<QPointF> offsets;
+    std::vector<QColor> colors;
+    bool tiled;
+    QRectF bounds;
+    QPolygonF quad;
+    QPolygonF centres;
+    QPen pen;
+public:
+    GraphicsEnsembleItem(int numberOfRuns) :
+        poses(numberOfRuns),
+        offsets(numberOfRuns),
+        colors(numberOfRuns),
+        tiled(false),
+        bounds(),
+        quad(4)
+    {
+        for(int i = 0; i < numberOfRuns; ++i)
+        {
+            colors[i] = QColor::fromHsv((360*i)/std::max(1,numberOfRuns),200,230);
+        }
+        pen.setStyle(Qt::SolidLine);
+        pen.setCosmetic(true);
+        pen.setBrush(Qt::black);
+    }
+
+    void setTiled(bool t)
+    {
+        tiled = t;
+    }
+
+    void setPoses(int run, const std::vector<segmentPose> & p)
+    {
+        poses[run] = p;
+    }
+
+    // Call once all runs of a frame are set
+    void updateGeometry()
+    {
+        typedef robot_dimensions<SCALE_ALL_FACTOR> RD;
+        const int columns = int(std::ceil(std::sqrt(float(poses.size()))));
+        size_t longest = 0;
+        for(size_t r = 0; r < poses.size(); ++r)
+        {
+            longest = std::max(longest,poses[r].size());
+        }
+        const float tile = 1.2f*float(longest)*(RD::segmentMCtoForwardJointConnection(0)+RD::segmentMCtoBackwardJointConnection(0));
+        const float margin = RD::segmentMCtoEdgeForward(0)+RD::segmentMCtoEdgeLeft(0);
+        QRectF b;
+        for(size_t r = 0; r < poses.size(); ++r)
+        {
+            offsets[r] = QPointF(0.0,0.0);
+            if(poses[r].empty())
+            {
+                continue;
+            }
+            if(tiled)
+            {
+                float cx = 0.0f, cy = 0.0f;
+                for(size_t i = 0; i < poses[r].size(); ++i)
+                {
+                    cx += poses[r][i].x;
+                    cy += poses[r][i].y;
+                }
+                cx /= float(poses[r].size());
+                cy /= float(poses[r].size());
+                offsets[r] = QPointF((r % columns)*tile - cx, (r / columns)*tile - cy);
+            }
+            for(size_t i = 0; i < poses[r].size(); ++i)
+            {
+                QPointF c = QPointF(poses[r][i].x,poses[r][i].y) + offsets[r];
+                QRectF s(c.x()-margin,c.y()-margin,2*margin,2*margin);
+                b = b.isNull() ? s : b.united(s);
+            }
+        }
+        prepareGeometryChange();
+        bounds = b;
+    }
+
+    QRectF boundingRect() const
+    {
+        return bounds;
+    }
+
+    void paint(QPainter* painter, const QStyleOptionGraphicsItem* /*option*/, QWidget* /*widget*/)
+    {
+        typedef robot_dimensions<SCALE_ALL_FACTOR> RD;
+        const snakeDetail detail = getSnakeDetail(QStyleOptionGraphicsItem::levelOfDetailFromTransform(painter->worldTransform()));
+        if(detail == SNAKE_DETAIL_LINE)
+        {
+            paintLines(painter);
+            return;
+        }
+        painter->setPen(detail == SNAKE_DETAIL_FULL ? pen : QPen(Qt::NoPen));
+        for(size_t r = 0; r < poses.size(); ++r)
+        {
+            painter->setBrush(colors[r]);
+            for(size_t i = 0; i < poses[r].size(); ++i)
+            {
+                const segmentPose & p = poses[r][i];
+                const float c = std::cos(p.rot);
+                const float s = std::sin(p.rot);
+                const float f = RD::segmentMCtoEdgeForward(i);
+                const float b = -RD::segmentMCtoEdgeBackward(i);
+                const float l = -RD::segmentMCtoEdgeLeft(i);
+                const float rt = RD::segmentMCtoEdgeRight(i);
+                const QPointF o = QPointF(p.x,p.y) + offsets[r];
+                quad[0] = o + QPointF(b*c - l*s, b*s + l*c);
+                quad[1] = o + QPointF(f*c - l*s, f*s + l*c);
+                quad[2] = o + QPointF(f*c - rt*s, f*s + rt*c);
+                quad[3] = o + QPointF(b*c - rt*s, b*s + rt*c);
+                painter->drawPolygon(quad);
+            }
+        }
+    }
+
+private:
+    void paintLines(QPainter* painter)
+    {
+        typedef robot_dimensions<SCALE_ALL_FACTOR> RD;
+        QPen line(Qt::SolidLine);
+        line.setWidthF(RD::segmentMCtoEdgeLeft(0)+RD::segmentMCtoEdgeRight(0));
+        line.setCapStyle(Qt::RoundCap);
+        line.setJoinStyle(Qt::RoundJoin);
+        for(size_t r = 0; r < poses.size(); ++r)
+        {
+            centres.resize(int(poses[r].size()));
+            for(size_t i = 0; i < poses[r].size(); ++i)
+            {
+                centres[int(i)] = QPointF(poses[r][i].x,poses[r][i].y) + offsets[r];
+            }
+            line.setColor(colors[r]);
+            painter->setPen(line);
+            painter->drawPolyline(centres);
+        }
+    }
+};
 
 
 #endif // GRAPHICSITEMS_H
@@ -1,11 +1,134 @@
 #include "mainwindow.h"
+#include "frameexporter.h"
+#include "simdkernels.h"
+#include "runcache.h"
 #include <QApplication>
+#include <QCommandLineParser>
+#include <QTextStream>
+#include <chrono>
+
+// Parses the export options, returns false if any of them is malformed
+static bool getExportOptions(const QCommandLineParser & parser, exportOptions & options)
+{
+    bool ok = true;
+    bool valid = true;
+    options.inputFile = parser.value("export");
+    options.outputDirectory = parser.value("output");
+    options.fps = parser.value("fps").toFloat(&ok);
+    valid = valid && ok;
+    options.begin = parser.value("begin").toFloat(&ok);
+    valid = valid && ok;
+    options.end = parser.value("end").toFloat(&ok);
+    valid = valid && ok;
+    QStringList size = parser.value("size").split('x');
+    valid = valid && size.size() == 2;
+    if(size.size() == 2)
+    {
+        options.width = size[0].toInt(&ok);
+        valid = valid && ok;
+        options.height = size[1].toInt(&ok);
+        valid = valid && ok;
+    }
+    QString view = parser.value("view");
+    valid = valid && (view == "follow" || view == "fit");
+    options.followCM = view == "follow";
+    QStringList channels;
+    channels << "none" << "torque" << "force" << "speed";
+    int channel = channels.indexOf(parser.value("heatmap"));
+    valid = valid && channel >= 0;
+    options.heatChannel = channel-1;
+    QStringList show = parser.value("show").split(',',Qt::SkipEmptyParts);
+    options.showForces = show.contains("forces");
+    options.showSpeeds = show.contains("speeds");
+    options.showTorques = show.contains("torques");
+    options.showTorqueHistory = show.contains("history");
+    options.showTotals = show.contains("totals");
+    options.showTrails = show.contains("trails");
+    return valid;
+}
 
 int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Displays recordings and live runs of the snake robot simulation.");
+    parser.addHelpOption();
+    parser.addOptions({
+        {"export", "Render <file> to a PNG sequence instead of opening the window. Combine with -platform offscreen to run without a display.", "file"},
+        {"output", "Directory the exported frames are written to.", "directory", "."},
+        {"fps", "Exported frames per simulated second.", "rate", "50"},
+        {"size", "Size of the exported images.", "WxH", "1280x720"},
+        {"begin", "Simulation time of the first exported frame.", "seconds", "0"},
+        {"end", "Simulation time of the last exported frame, negative for the end of the file.", "seconds", "-1"},
+        {"view", "follow keeps the centre of mass in the middle, fit frames the whole run.", "mode", "follow"},
+        {"heatmap", "Colour the segments by none, torque, force or speed.", "channel", "none"},
+        {"show", "Comma separated overlays: forces, speeds, torques, history, totals, trails.", "list", "forces,speeds,torques,totals,trails"},
+        {"trace", "Record a Chrome trace of the whole session to <file>.", "file"},
+        {"simd", "Force the numeric kernels to scalar, sse4.2, avx2 or avx512 instead of the best the CPU supports.", "level"},
+        {"storage", "Keep the samples of opened files as float32, float16 or int16, the compact ones take half the memory.", "type", "float32"},
+        {"cache-dir", "Directory large files are cached in for fast reopening.", "directory", getRunCacheDirectory()},
+        {"no-cache", "Parse every file instead of using or writing caches."}
+    });
+    parser.process(a);
+    traceRecorder::setThreadName("main");
+    if(parser.isSet("simd"))
+    {
+        simdLevel level;
+        if(!parseSimdLevel(parser.value("simd"),level) || !setSimdLevel(level))
+        {
+            QTextStream(stdout) << "SIMD level " << parser.value("simd") << " is not supported, the best this CPU supports is "
+                                << getSimdLevelName(getSupportedSimdLevel()) << Qt::endl;
+            return 1;
+        }
+    }
+    sampleStorage storage;
+    if(!parseStorage(parser.value("storage"),storage))
+    {
+        QTextStream(stdout) << "Unknown storage " << parser.value("storage") << ", see --help" << Qt::endl;
+        return 1;
+    }
+    setDefaultStorage(storage);
+    setRunCacheDirectory(parser.isSet("no-cache") ? QString() : parser.value("cache-dir"));
+    if(parser.isSet("trace"))
+    {
+        traceRecorder::start();
+    }
+
+    if(parser.isSet("export"))
+    {
+        QTextStream out(stdout);
+        exportOptions options;
+        if(!getExportOptions(parser,options))
+        {
+            out << "Invalid export options, see --help" << Qt::endl;
+            return 1;
+        }
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        frameExporter exporter(options);
+        int written = exporter.run();
+        if(written < 0)
+        {
+            out << "Export of " << options.inputFile << " failed" << Qt::endl;
+            return 1;
+        }
+        float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now()-start).count();
+        if(parser.isSet("trace"))
+        {
+            traceRecorder::stop(parser.value("trace"));
+        }
+        out << "Wrote " << written << " frames to " << options.outputDirectory << " in " << seconds << " s ("
+            << (seconds > 0.0f ? float(written)/seconds : 0.0f) << " frames/s)" << Qt::endl;
+        return 0;
+    }
+
     MainWindow w;
     w.show();
 
-    return a.exec();
+    int result = a.exec();
+    if(traceRecorder::isRecording() && parser.isSet("trace"))
+    {
+        traceRecorder::stop(parser.value("trace"));
+    }
+    return result;
 }
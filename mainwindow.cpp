@@ -4,8 +4,10 @@
 #include <chrono>
 #include <QGraphicsView>
 #include <QFileDialog>
-#include <QtOpenGL/QGLWidget>
+#include <QOpenGLWidget>
+#include <QSurfaceFormat>
 #include <QWindow>
+#include <QMouseEvent>
 
 MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent),
@@ -14,23 +16,52 @@ MainWindow::MainWindow(QWidget *parent) :
     isRefreshing(false),
     isOnFirstIteration(true),
     readState(READ_STATE_NONE),
+    timeScale(1.0f),
     simState(SIM_PAUSED),
+    playDirection(1),
+    loopBegin(0.0f),
+    loopEnd(-1.0f),
+    dirtyThresholdPixels(DEFAULT_DIRTY_THRESHOLD_PIXELS),
+    lastRenderedTime(-1.0f),
+    sceneDirty(true),
     segments(),
-    forces(),
-    speeds(),
+    snakeLine(nullptr),
+    forceField(nullptr),
+    speedField(nullptr),
+    pickerDirty(true),
+    hovering(false),
     torques(nullptr),
+    heatChannel(-1),
     totalForce(nullptr),
     totalSpeed(nullptr),
-    timeScale(1.0f)
+    headTrail(nullptr),
+    mcTrail(nullptr),
+    trailSample(-1),
+    ensembleItem(nullptr),
+    rangeIndexStale(false),
+    comparison(nullptr),
+    ghostItem(nullptr)
 {
     ui->setupUi(this);
+    traceRecorder::setThreadName("GUI");
     ui->statusBar->showMessage("No input file is specified");
     QString filePath = QCoreApplication::applicationDirPath() + "/display2Dconnection.dat";
     ui->filepathOut->setText(filePath);
     mli = nullptr;
     mlf = nullptr;
+    prefetcher = nullptr;
+    fileCursor = 0;
+    ensemble = nullptr;
     ui->graphicsView->setScene(m_graphics = new QGraphicsScene());
-    ui->graphicsView->setViewport(new QGLWidget(QGLFormat(QGL::SampleBuffers)));
+    // Nearly every item moves every frame, a BSP index would be rebuilt all the time
+    m_graphics->setItemIndexMethod(QGraphicsScene::NoIndex);
+    QOpenGLWidget * viewport = new QOpenGLWidget();
+    QSurfaceFormat viewportFormat;
+    viewportFormat.setSamples(4);
+    viewport->setFormat(viewportFormat);
+    ui->graphicsView->setViewport(viewport);
+    viewport->setMouseTracking(true);
+    viewport->installEventFilter(this);
     ui->graphicsView->setBackgroundBrush(Qt::gray);
     ui->graphicsView->centerOn(0.0f,0.0f);
     ui->graphicsView->update();
@@ -38,24 +69,76 @@ MainWindow::MainWindow(QWidget *parent) :
     ui->horizontalSlider->setRange(0, SLIDER_MAX_VALUE);
     ui->horizontalSlider->setEnabled(false);
     ui->playButton->setEnabled(false);
+    ui->reverseButton->setEnabled(false);
+    ui->stepBackButton->setEnabled(false);
+    ui->stepForwardButton->setEnabled(false);
+    ui->findNextButton->setEnabled(false);
+    ui->findMaxButton->setEnabled(false);
     ui->timeLabel->setEnabled(false);
     showForcesStateChanged = false;
     showSpeedsStateChanged = false;
     showTorquesStateChanged = false;
     showTotForceStateChanged = false;
     showTotSpeedStateChanged = false;
+    showTrailsStateChanged = false;
+    scheduler = new FrameScheduler(1000.0f/float(REFRESH_INTERVAL_MILLISEC),this);
+    scheduler->attach(viewport);
+    profiler = new frameProfiler(this);
+    profiler->attach(viewport);
+    overlay = new profilerOverlay(profiler,ui->graphicsView);
+    overlay->move(4,4);
+    overlay->hide();
+    QObject::connect(scheduler,SIGNAL(frame()),this,SLOT(refreshChain()));
+    ui->rateSpinBox->setValue(int(scheduler->getTargetRate()+0.5f));
     printState();
-    refresh(false);
+    scheduler->start();
 
     QObject::connect(ui->actionSelect_simulation_file,SIGNAL(triggered()),this,SLOT(openFile()));
     QObject::connect(ui->actionSelect_shared_memory_file,SIGNAL(triggered()),this,SLOT(openMmap()));
+    QObject::connect(ui->actionSelect_ensemble_files,SIGNAL(triggered()),this,SLOT(openEnsemble()));
+    QObject::connect(ui->actionTile_ensemble,SIGNAL(toggled(bool)),this,SLOT(tileEnsemble(bool)));
+    QObject::connect(ui->actionFollow_file,SIGNAL(toggled(bool)),this,SLOT(followFile(bool)));
+    tailTimer.setSingleShot(true);
+    tailTimer.setInterval(TAIL_DELAY_MILLISEC);
+    QObject::connect(&tailWatcher,SIGNAL(fileChanged(QString)),this,SLOT(fileChanged()));
+    QObject::connect(&tailTimer,SIGNAL(timeout()),this,SLOT(readTail()));
+    QObject::connect(ui->actionSelect_reference_file,SIGNAL(triggered()),this,SLOT(openReference()));
+    QObject::connect(ui->actionClear_reference,SIGNAL(triggered()),this,SLOT(clearReference()));
+    QObject::connect(ui->actionShow_frame_profiler,SIGNAL(toggled(bool)),this,SLOT(showProfiler(bool)));
+    QObject::connect(ui->actionRecord_trace,SIGNAL(toggled(bool)),this,SLOT(recordTrace(bool)));
+    QObject::connect(ui->actionSet_loop_begin,SIGNAL(triggered()),this,SLOT(setLoopBegin()));
+    QObject::connect(ui->actionSet_loop_end,SIGNAL(triggered()),this,SLOT(setLoopEnd()));
+    QObject::connect(ui->actionClear_loop_range,SIGNAL(triggered()),this,SLOT(clearLoopRange()));
+    QObject::connect(&statisticsWatcher,SIGNAL(finished()),this,SLOT(statisticsReady()));
 }
 
 MainWindow::~MainWindow()
 {
+    statisticsWatcher.waitForFinished();
+    cacheSaving.waitForFinished();
+    delete prefetcher;
+    delete ensemble;
+    delete comparison;
     delete ui;
 }
 
+void MainWindow::setDirtyThreshold(float pixels)
+{
+    dirtyThresholdPixels = pixels;
+    sceneDirty = true;
+}
+
+float MainWindow::getSceneThreshold()
+{
+    // Convert the on-screen threshold into scene units using the current zoom of the view
+    qreal viewScale = ui->graphicsView->transform().m11();
+    if(viewScale <= 0.0)
+    {
+        return 0.0f;
+    }
+    return dirtyThresholdPixels/float(viewScale);
+}
+
 void MainWindow::printState()
 {
     if(mli)
@@ -68,83 +151,82 @@ void MainWindow::printState()
         ui->msgROut->setText(mli->messageRead() ? "true" : "false");
         ui->msgWOut->setText(mli->messageWritten() ? "true" : "false");
     }
+    ui->droppedOut->setText(QString::number(scheduler->getDroppedFrames()) + " / " + QString::number(scheduler->getFrameCount()));
 }
 
 void MainWindow::refresh(bool doOnce)
 {
-    std::chrono::time_point<std::chrono::system_clock> begin = std::chrono::system_clock::now();
-
+    traceScope trace("refresh");
+    scopedStageTimer frameTimer(profiler,STAGE_FRAME);
     if(mlf && readState == READ_STATE_FILE)
     {
-        if(simState == SIM_PLAYING)
+        advanceSimulationTime(mlf->get_lastTime());
+        // Nothing to do if the cursor hasn't moved since the last drawn frame
+        if(simulationTime != lastRenderedTime || sceneDirty || doOnce)
         {
-            std::chrono::time_point<std::chrono::system_clock> endRt = std::chrono::system_clock::now();
-            std::chrono::duration<double> elapsed_milliseconds = endRt-beginRt;
-            beginRt = std::chrono::system_clock::now();
-
-            simulationTime+=timeScale*float(elapsed_milliseconds.count());
-            ui->horizontalSlider->blockSignals(true);
-            ui->horizontalSlider->setValue(int((simulationTime/mlf->get_lastTime())*float(SLIDER_MAX_VALUE)));
-            ui->horizontalSlider->blockSignals(false);
-        }
-        if(simulationTime >= mlf->get_lastTime())
-        {
-            simulationTime = mlf->get_lastTime();
+            ui->timeLabel->setText(QString::number(simulationTime,'g',4));
+            // While playing the frame is normally ready in the prefetch queue
+            if(!(prefetcher && simState == SIM_PLAYING && prefetcher->take(simulationTime,frame)))
+            {
+                {
+                    scopedStageTimer seekTimer(profiler,STAGE_SEEK);
+                    mlf->locate(simulationTime,fileCursor);
+                }
+                // The cursor is now at the right sample, so this only interpolates
+                scopedStageTimer interpolationTimer(profiler,STAGE_INTERPOLATION);
+                mlf->sampleFrame(simulationTime,fileCursor,frame);
+            }
+            // Måla upp roboten här
+            updateSegments(frame);
+            updateFileTrails(frame);
+            updateComparison();
+            lastRenderedTime = simulationTime;
         }
-        mlf->iterateToClosestTimePoint(simulationTime);
-        ui->timeLabel->setText(QString::number(simulationTime,'g',4));
-        // Måla upp roboten här
-        std::vector<snakeSectionData> sections;
-        for(int i = 0; i < mlf->getNumberOfSections(); ++i)
+    }
+
+    if(ensemble && readState == READ_STATE_ENSEMBLE)
+    {
+        advanceSimulationTime(ensemble->get_lastTime());
+        if(simulationTime != lastRenderedTime || sceneDirty || doOnce)
         {
-            sections.push_back(mlf->getSection(i));
+            ui->timeLabel->setText(QString::number(simulationTime,'g',4));
+            ensemble->sampleAt(simulationTime);
+            for(int i = 0; i < ensemble->size(); ++i)
+            {
+                ensembleItem->setPoses(i,ensemble->run(i).poses);
+            }
+            ensembleItem->updateGeometry();
+            lastRenderedTime = simulationTime;
+            sceneDirty = false;
         }
-        updateSegments(mlf->getNumberOfSections(),mlf->get_headX(),mlf->get_headY(),mlf->get_headAngle(),sections);
     }
 
     if(mli && readState == READ_STATE_MMAP)
     {
         if(mli->readData())
         {
-            ui->l1->setText(QString::number(mli->get_headX()));
-            ui->l2->setText(QString::number(mli->get_headY()));
-            ui->l3->setText(QString::number(mli->get_headAngle()));
-            ui->l4->setText(QString::number(mli->getSection(0).d_phi));
-            ui->l5->setText(QString::number(mli->getSection(9).f_res_x));
-            ui->l6->setText(QString::number(mli->getSection(9).f_res_y));
-            ui->l7->setText(QString::number(mli->getSection(0).x));
-            ui->l8->setText(QString::number(mli->getSection(0).y));
-            ui->l9->setText(QString::number(mli->getSection(0).torque));
-
             // Prepare data for showing
-            std::vector<snakeSectionData> sections;
-            sections.clear();
-            for(int i = 0; i < mli->getNumberOfSections(); ++i)
-            {
-                sections.push_back(mli->getSection(i));
-            }
+            readSharedMemoryFrame();
 
             if(mli->getIteration() != iteration && isOnFirstIteration)
             {
                 isOnFirstIteration = false;
                 iteration = mli->getIteration();
                 numSegments = mli->getNumberOfSections();
-                changeSegments(mli->getNumberOfSections(),mli->get_headX(),mli->get_headY(),mli->get_headAngle(),sections);
-                //changeSegments(mli->getNumberOfSections(),0.0f,0.0f,0.0f,sections);
+                changeSegments(frame);
             }
             else if(mli->getNumberOfSections() != numSegments)
             {
                 numSegments = mli->getNumberOfSections();
                 iteration = mli->getIteration();
-                changeSegments(mli->getNumberOfSections(),mli->get_headX(),mli->get_headY(),mli->get_headAngle(),sections);
-                //changeSegments(mli->getNumberOfSections(),0.0f,0.0f,0.0f,sections);
+                changeSegments(frame);
             }
-            else if(mli->getIteration() != iteration || doOnce)
+            else if(mli->getIteration() != iteration || doOnce || sceneDirty)
             {
                 iteration = mli->getIteration();
-                updateSegments(mli->getNumberOfSections(),mli->get_headX(),mli->get_headY(),mli->get_headAngle(),sections);
-                //updateSegments(mli->getNumberOfSections(),0.0f,0.0f,0.0f,sections);
+                updateSegments(frame);
             }
+            updateLiveTrails(frame);
             ui->graphicsView->update();
             ui->graphicsView->show();
 
@@ -152,150 +234,324 @@ void MainWindow::refresh(bool doOnce)
     }
 
     printState();
-    std::chrono::time_point<std::chrono::system_clock> end = std::chrono::system_clock::now();
-    std::chrono::duration<double> elapsed_milliseconds = end-begin;
-    if(!exit)
+    if(profiler->isEnabled() && scheduler->getFrameCount() % 10 == 0)
     {
-        if(static_cast<double>(REFRESH_INTERVAL_MILLISEC)-elapsed_milliseconds.count() < 0 && !doOnce)
-        {
-            refresh(false);
-        }
-        else if(!doOnce)
+        overlay->update();
+    }
+    // The next frame is started by the scheduler
+    if(exit)
+    {
+        scheduler->stop();
+    }
+}
+
+void MainWindow::advanceSimulationTime(float lastTime)
+{
+    if(simState == SIM_PLAYING)
+    {
+        std::chrono::time_point<std::chrono::steady_clock> endRt = std::chrono::steady_clock::now();
+        std::chrono::duration<double> elapsed_milliseconds = endRt-beginRt;
+        beginRt = endRt;
+
+        simulationTime+=playDirection*timeScale*float(elapsed_milliseconds.count());
+        if(ui->loopButton->isChecked())
         {
-            QTimer::singleShot(REFRESH_INTERVAL_MILLISEC - elapsed_milliseconds.count(), this, SLOT(refreshChain()));
+            // Wrap around inside the loop range, in either direction
+            const float begin = std::max(0.0f,std::min(loopBegin,lastTime));
+            const float end = loopEnd < 0.0f ? lastTime : std::min(loopEnd,lastTime);
+            if(end > begin && (simulationTime > end || simulationTime < begin))
+            {
+                const float length = end-begin;
+                simulationTime = begin + std::fmod(std::fmod(simulationTime-begin,length)+length,length);
+                if(prefetcher && readState == READ_STATE_FILE)
+                {
+                    prefetcher->seek(simulationTime);
+                }
+            }
         }
+        updateSlider(lastTime);
+    }
+    if(simulationTime >= lastTime)
+    {
+        simulationTime = lastTime;
+    }
+    if(simulationTime < 0.0f)
+    {
+        simulationTime = 0.0f;
     }
 }
 
+void MainWindow::updateSlider(float lastTime)
+{
+    ui->horizontalSlider->blockSignals(true);
+    ui->horizontalSlider->setValue(int((simulationTime/lastTime)*float(SLIDER_MAX_VALUE)));
+    ui->horizontalSlider->blockSignals(false);
+}
+
+float MainWindow::getLastTime()
+{
+    if(readState == READ_STATE_ENSEMBLE && ensemble)
+    {
+        return ensemble->get_lastTime();
+    }
+    if(mlf)
+    {
+        return mlf->get_lastTime();
+    }
+    return 0.0f;
+}
+
 void MainWindow::refreshChain()
 {
     refresh(false);
 }
 
-void MainWindow::changeSegments(const int numberOfSegments,
-                                float headX, float headY, float headAngle,
-                                std::vector<snakeSectionData> & sections)
+void MainWindow::readSharedMemoryFrame()
 {
-    typedef robot_dimensions<SCALE_ALL_FACTOR> RD;
-    removeAll(segments);
-    removeAll(forces);
-    removeAll(speeds);
-    removeAll(torques);
-    removeAll(totalForce);
-    removeAll(totalSpeed);
-    m_graphics->clear();
+    traceScope trace("ingest");
+    frame.t = 0.0f;
+    frame.sample = -1;
+    frame.headX = mli->get_headX();
+    frame.headY = mli->get_headY();
+    frame.headAngle = mli->get_headAngle();
+    frame.sections.resize(mli->getNumberOfSections());
+    for(int i = 0; i < mli->getNumberOfSections(); ++i)
+    {
+        frame.sections[i] = mli->getSection(i);
+    }
+    frame.aggregates = computeAggregates(frame.sections);
+}
+
+void MainWindow::changeSegments(const snakeFrame & frame)
+{
+    const int numberOfSegments = int(frame.sections.size());
+    clearScene();
     showForcesStateChanged = true;
     showSpeedsStateChanged = true;
     showTorquesStateChanged = true;
     showTotForceStateChanged = true;
     showTotSpeedStateChanged = true;
+    showTrailsStateChanged = true;
+    headTrail = new GraphicsTrailItem(TRAIL_CAPACITY,HeadTrailColor);
+    headTrail->setZValue(0.5f);
+    m_graphics->addItem(headTrail);
+    mcTrail = new GraphicsTrailItem(TRAIL_CAPACITY,MCTrailColor);
+    mcTrail->setZValue(0.5f);
+    m_graphics->addItem(mcTrail);
+    trailSample = -1;
     totalForce = new GraphicsArrowItem(TotalForceColor);
     m_graphics->addItem(totalForce);
     totalSpeed = new GraphicsArrowItem(TotalSpeedColor);
     m_graphics->addItem(totalSpeed);
-    torques = new GraphicsTorqueDisplay(0.25f,getSnakeLength(sections),numberOfSegments-1,TorquePerSegmentColor);
+    torques = new GraphicsTorqueDisplay(0.25f,getSnakeLength(frame),numberOfSegments-1,TorquePerSegmentColor);
     m_graphics->addItem(torques);
-    float dx=0.0f,dy=0.0f,rot=0.0f;
+    forceField = new GraphicsArrowFieldItem(/*ForcePerSegmentColor*/Qt::yellow);
+    forceField->setZValue(2.0f);
+    m_graphics->addItem(forceField);
+    speedField = new GraphicsArrowFieldItem(SpeedPerSegmentColor);
+    speedField->setZValue(3.0f);
+    m_graphics->addItem(speedField);
     for(int i = 0; i < numberOfSegments; ++i)
     {
         GraphicsSegmentItem * seg = new GraphicsSegmentItem(i,numberOfSegments);
-        GraphicsArrowItem * force = new GraphicsArrowItem(/*ForcePerSegmentColor*/Qt::yellow);
-        GraphicsArrowItem * speed = new GraphicsArrowItem(SpeedPerSegmentColor);
         seg->setZValue(1.0f);
-        force->setZValue(2.0f);
-        speed->setZValue(3.0f);
-        //GraphicsArrowItem * torque = new GraphicsArrowItem(QColor(TorquePerSegmentColor));
         segments.push_back(seg);
-        forces.push_back(force);
-        speeds.push_back(speed);
-        //torques.push_back(torque);
         m_graphics->addItem(seg);
-        m_graphics->addItem(force);
-        m_graphics->addItem(speed);
-        //m_graphics->addItem(torque);
-        if(i == 0)
+    }
+    snakeLine = new GraphicsSnakeLineItem(Qt::green);
+    snakeLine->setZValue(1.0f);
+    m_graphics->addItem(snakeLine);
+    // Place everything without any threshold
+    sceneDirty = true;
+    updateSegments(frame);
+}
+
+int MainWindow::getArrowStride()
+{
+    typedef robot_dimensions<SCALE_ALL_FACTOR> RD;
+    // Thin out the arrows once neighbouring segments are closer than this on screen
+    const float minimumSpacingPixels = 12.0f;
+    const float spacing = float(ui->graphicsView->transform().m11())*
+                          (RD::segmentMCtoForwardJointConnection(0)+RD::segmentMCtoBackwardJointConnection(0));
+    if(spacing >= minimumSpacingPixels || spacing <= 0.0f)
+    {
+        return 1;
+    }
+    return int(std::ceil(minimumSpacingPixels/spacing));
+}
+
+void MainWindow::updateSegments(const snakeFrame & frame)
+{
+    traceScope trace("updateSegments");
+    const std::vector<snakeSectionData> & sections = frame.sections;
+    typedef robot_dimensions<SCALE_ALL_FACTOR> RD;
+    // Changes smaller than this are not pushed to the scene, unless the scene must be redrawn anyway
+    const float threshold = sceneDirty ? 0.0f : getSceneThreshold();
+    {
+        scopedStageTimer kinematicsTimer(profiler,STAGE_KINEMATICS);
+        computeFramePoses(frame,poses);
+    }
+    scopedStageTimer sceneTimer(profiler,STAGE_SCENE_UPDATE);
+    for(int i = 0; i < segments.size(); ++i)
+    {
+        GraphicsSegmentItem* const seg = segments[i];
+        updateItemPose(seg,poses[i].x,poses[i].y,poses[i].rot*180/3.14,threshold,RD::segmentMCtoBackwardJointEnd(i));
+        if(heatChannel >= 0)
         {
-            rot = headAngle;
-            dx = headX*SCALE_ALL_FACTOR;
-            dy = headY*SCALE_ALL_FACTOR;
+            const float v = channelValue(sections[i],heatChannel);
+            if(readState == READ_STATE_MMAP)
+            {
+                heatmap.include(v);
+            }
+            seg->setHeatIndex(&heatmap,heatmap.index(v));
         }
         else
         {
-            dx-=cos(rot)*RD::segmentMCtoBackwardJointConnection(i-1);
-            dy-=sin(rot)*RD::segmentMCtoBackwardJointConnection(i-1);
-            rot+=sections.at(i-1).phi;
-            dx-=cos(rot)*RD::segmentMCtoForwardJointConnection(i);
-            dy-=sin(rot)*RD::segmentMCtoForwardJointConnection(i);
+            seg->setHeatIndex(nullptr,-1);
         }
-        seg->setRotation(rot*180/3.14);
-        seg->setPos(dx,dy);
-        force->setPos(dx,dy);
-        force->modify(sections[i].f_res_x,sections[i].f_res_y,ui->forceVecsButton->isChecked());
-        speed->setPos(dx,dy);
-        speed->modify(sections[i].dx,sections[i].dy,ui->speedVecsButton->isChecked());
-        displayMCSpeed(ui->totSpeedButton->isChecked(),sections,totalSpeed);
-        displayTotalForce(ui->totForceButton->isChecked(),sections,totalForce);
-        displayTorque(ui->torquesButton->isChecked(),sections,torques);
-    }
-    toggleGroup(forces,ui->forceVecsButton->isChecked(),showForcesStateChanged);
-    toggleGroup(speeds,ui->speedVecsButton->isChecked(),showSpeedsStateChanged);
+    }
+    snakeLine->setPoses(poses);
+    pickerDirty = true;
+    if(hovering)
+    {
+        updateHover();
+    }
+
+    // Gather the vector fields into flat arrays for the arrow overlays
+    const int n = int(sections.size());
+    forceX.resize(n);
+    forceY.resize(n);
+    speedX.resize(n);
+    speedY.resize(n);
+    for(int i = 0; i < n; ++i)
+    {
+        forceX[i] = sections[i].f_res_x;
+        forceY[i] = sections[i].f_res_y;
+        speedX[i] = sections[i].dx;
+        speedY[i] = sections[i].dy;
+    }
+    const int stride = getArrowStride();
+    if(ui->forceVecsButton->isChecked())
+    {
+        forceField->setField(poses,forceX.data(),forceY.data(),n,stride,threshold);
+    }
+    if(ui->speedVecsButton->isChecked())
+    {
+        speedField->setField(poses,speedX.data(),speedY.data(),n,stride,threshold);
+    }
+
+    displayMCSpeed(ui->totSpeedButton->isChecked(),frame,totalSpeed,threshold);
+    displayTotalForce(ui->totForceButton->isChecked(),frame,totalForce,threshold);
+    displayTorque(ui->torquesButton->isChecked(),frame,torques,threshold);
+    toggleGroup(forceField,ui->forceVecsButton->isChecked(),showForcesStateChanged);
+    toggleGroup(speedField,ui->speedVecsButton->isChecked(),showSpeedsStateChanged);
     toggleGroup(torques,ui->torquesButton->isChecked(),showTorquesStateChanged);
     toggleGroup(totalForce,ui->totForceButton->isChecked(),showTotForceStateChanged);
     toggleGroup(totalSpeed,ui->totSpeedButton->isChecked(),showTotSpeedStateChanged);
+    bool mcTrailStateChanged = showTrailsStateChanged;
+    toggleGroup(headTrail,ui->trailButton->isChecked(),showTrailsStateChanged);
+    toggleGroup(mcTrail,ui->trailButton->isChecked(),mcTrailStateChanged);
     showForcesStateChanged = false;
     showSpeedsStateChanged = false;
     showTorquesStateChanged = false;
     showTotForceStateChanged = false;
     showTotSpeedStateChanged = false;
+    showTrailsStateChanged = false;
+    sceneDirty = false;
 }
 
-void MainWindow::updateSegments(const int /*numberOfSegments*/,
-                                float headX, float headY,float headAngle,
-                                std::vector<snakeSectionData> & sections)
+bool MainWindow::eventFilter(QObject * watched, QEvent * event)
 {
-    typedef robot_dimensions<SCALE_ALL_FACTOR> RD;
-    float dx=0.0f,dy=0.0f,rot=0.0f;
-    for(int i = 0; i < segments.size(); ++i)
+    if(event->type() == QEvent::MouseMove)
     {
-        QGraphicsItem* const seg = segments[i];
-        GraphicsArrowItem* const force = static_cast<GraphicsArrowItem* const>(forces[i]);
-        GraphicsArrowItem* const speed = static_cast<GraphicsArrowItem* const>(speeds[i]);
-        //QGraphicsItem* torque = segments->childItems().at(i);
-        if(i == 0)
+        hovering = true;
+        hoverPos = ui->graphicsView->mapToScene(static_cast<QMouseEvent*>(event)->pos());
+        updateHover();
+    }
+    else if(event->type() == QEvent::Leave)
+    {
+        hovering = false;
+        updateHover();
+    }
+    return QMainWindow::eventFilter(watched,event);
+}
+
+void MainWindow::updateHover()
+{
+    int segment = -1;
+    if(hovering && frame.sections.size() == poses.size())
+    {
+        if(pickerDirty)
         {
-            rot = headAngle;
-            dx = headX*SCALE_ALL_FACTOR;
-            dy = headY*SCALE_ALL_FACTOR;
+            segmentPicker.build(poses);
+            pickerDirty = false;
         }
-        else
-        {
-            dx-=cos(rot)*RD::segmentMCtoBackwardJointConnection(i-1);
-            dy-=sin(rot)*RD::segmentMCtoBackwardJointConnection(i-1);
-            rot+=sections.at(i-1).phi;
-            dx-=cos(rot)*RD::segmentMCtoForwardJointConnection(i);
-            dy-=sin(rot)*RD::segmentMCtoForwardJointConnection(i);
+        segment = segmentPicker.find(float(hoverPos.x()),float(hoverPos.y()));
+    }
+    if(segment < 0)
+    {
+        ui->segmentOut->clear();
+        return;
+    }
+    const snakeSectionData & s = frame.sections[segment];
+    ui->segmentOut->setText(QString("%1\nx %2, y %3, phi %4\ndx %5, dy %6, d_phi %7\nf_res_x %8, f_res_y %9, torque %10")
+                            .arg(segment)
+                            .arg(s.x).arg(s.y).arg(s.phi)
+                            .arg(s.dx).arg(s.dy).arg(s.d_phi)
+                            .arg(s.f_res_x).arg(s.f_res_y).arg(s.torque));
+}
 
+void MainWindow::updateFileTrails(const snakeFrame & frame)
+{
+    if(!headTrail || !mcTrail || frame.sample < 0)
+    {
+        return;
+    }
+    const int current = frame.sample;
+    int begin = trailSample+1;
+    const int back = trailSample-current;
+    if(back > 0 && back < headTrail->size())
+    {
+        // Step back, drop the newest points and restore as many older ones as the ring had lost
+        const int oldest = trailSample-headTrail->size()+1;
+        headTrail->truncate(back);
+        mcTrail->truncate(back);
+        for(int i = oldest-1; i >= std::max(0,oldest-back); --i)
+        {
+            snakeMCPos head = mlf->getHeadPosition(i);
+            snakeMCPos mc = mlf->getMCPosition(i);
+            headTrail->prepend(head.x*SCALE_ALL_FACTOR,head.y*SCALE_ALL_FACTOR);
+            mcTrail->prepend(mc.x*SCALE_ALL_FACTOR,mc.y*SCALE_ALL_FACTOR);
         }
-        seg->setRotation(rot*180/3.14);
-        seg->setPos(dx,dy);
-        force->setPos(dx,dy);
-        force->modify(sections[i].f_res_x,sections[i].f_res_y,ui->forceVecsButton->isChecked());
-        speed->setPos(dx,dy);
-        speed->modify(sections[i].dx,sections[i].dy,ui->speedVecsButton->isChecked());
-        displayMCSpeed(ui->totSpeedButton->isChecked(),sections,totalSpeed);
-        displayTotalForce(ui->totForceButton->isChecked(),sections,totalForce);
-        displayTorque(ui->torquesButton->isChecked(),sections,torques);
-    }
-    toggleGroup(forces,ui->forceVecsButton->isChecked(),showForcesStateChanged);
-    toggleGroup(speeds,ui->speedVecsButton->isChecked(),showSpeedsStateChanged);
-    toggleGroup(torques,ui->torquesButton->isChecked(),showTorquesStateChanged);
-    toggleGroup(totalForce,ui->totForceButton->isChecked(),showTotForceStateChanged);
-    toggleGroup(totalSpeed,ui->totSpeedButton->isChecked(),showTotSpeedStateChanged);
-    showForcesStateChanged = false;
-    showSpeedsStateChanged = false;
-    showTorquesStateChanged = false;
-    showTotForceStateChanged = false;
-    showTotSpeedStateChanged = false;
+        trailSample = current;
+        return;
+    }
+    if(back > 0 || current-trailSample > TRAIL_CAPACITY)
+    {
+        // Seek, rebuild the trail from the precomputed path
+        headTrail->clear();
+        mcTrail->clear();
+        begin = std::max(0,current-TRAIL_CAPACITY+1);
+    }
+    for(int i = begin; i <= current; ++i)
+    {
+        snakeMCPos head = mlf->getHeadPosition(i);
+        snakeMCPos mc = mlf->getMCPosition(i);
+        headTrail->push(head.x*SCALE_ALL_FACTOR,head.y*SCALE_ALL_FACTOR);
+        mcTrail->push(mc.x*SCALE_ALL_FACTOR,mc.y*SCALE_ALL_FACTOR);
+    }
+    trailSample = current;
+}
+
+void MainWindow::updateLiveTrails(const snakeFrame & frame)
+{
+    if(!headTrail || !mcTrail || frame.sections.empty())
+    {
+        return;
+    }
+    std::pair<float,float> mc = getMCPos(frame);
+    headTrail->push(frame.headX*SCALE_ALL_FACTOR,frame.headY*SCALE_ALL_FACTOR);
+    mcTrail->push(mc.first,mc.second);
 }
 
 float MainWindow::getHeadingAngleOfSnake(const float headAngle, const std::vector<snakeSectionData> & sections)
@@ -309,6 +565,36 @@ float MainWindow::getHeadingAngleOfSnake(const float headAngle, const std::vecto
     return factor*r; /* According to the book, (2.2) */
 }
 
+void MainWindow::clearScene()
+{
+    removeAll(segments);
+    removeAll(snakeLine);
+    removeAll(forceField);
+    removeAll(speedField);
+    removeAll(torques);
+    removeAll(totalForce);
+    removeAll(totalSpeed);
+    removeAll(headTrail);
+    removeAll(mcTrail);
+    removeAll(ensembleItem);
+    removeAll(ghostItem);
+    snakeLine = nullptr;
+    forceField = nullptr;
+    speedField = nullptr;
+    torques = nullptr;
+    totalForce = nullptr;
+    totalSpeed = nullptr;
+    headTrail = nullptr;
+    mcTrail = nullptr;
+    ensembleItem = nullptr;
+    ghostItem = nullptr;
+    m_graphics->clear();
+    // Nothing to pick until the next frame is placed
+    poses.clear();
+    pickerDirty = true;
+    updateHover();
+}
+
 void MainWindow::removeAll(GraphicsArrowItem * g)
 {
     if(g)
@@ -325,14 +611,37 @@ void MainWindow::removeAll(GraphicsTorqueDisplay * g)
         delete g;
     }
 }
-void MainWindow::removeAll(QVector<GraphicsArrowItem*>& g)
+void MainWindow::removeAll(GraphicsTrailItem * g)
 {
-    for(int i = 0; i < g.size(); ++i)
+    if(g)
     {
-        m_graphics->removeItem(g[i]);
-        delete g[i];
+        m_graphics->removeItem(g);
+        delete g;
+    }
+}
+void MainWindow::removeAll(GraphicsEnsembleItem * g)
+{
+    if(g)
+    {
+        m_graphics->removeItem(g);
+        delete g;
+    }
+}
+void MainWindow::removeAll(GraphicsSnakeLineItem * g)
+{
+    if(g)
+    {
+        m_graphics->removeItem(g);
+        delete g;
+    }
+}
+void MainWindow::removeAll(GraphicsArrowFieldItem * g)
+{
+    if(g)
+    {
+        m_graphics->removeItem(g);
+        delete g;
     }
-    g.clear();
 }
 void MainWindow::removeAll(QVector<GraphicsSegmentItem*>& g)
 {
@@ -370,21 +679,28 @@ void MainWindow::toggleGroup(GraphicsTorqueDisplay* g, bool state, bool & toggle
     toggled = false;
 }
 
-void MainWindow::toggleGroup(QVector<GraphicsArrowItem*>& g, bool state, bool & toggled)
+void MainWindow::toggleGroup(GraphicsTrailItem* g, bool state, bool & toggled)
 {
     if(state && toggled)
     {
-        for(int i = 0; i < g.size(); ++i)
-        {
-            g[i]->setVisible(true);
-        }
+        g->setVisible(true);
     }
     else if(toggled)
     {
-        for(int i = 0; i < g.size(); ++i)
-        {
-            g[i]->setVisible(false);
-        }
+        g->setVisible(false);
+    }
+    toggled = false;
+}
+
+void MainWindow::toggleGroup(GraphicsArrowFieldItem* g, bool state, bool & toggled)
+{
+    if(state && toggled)
+    {
+        g->setVisible(true);
+    }
+    else if(toggled)
+    {
+        g->setVisible(false);
     }
     toggled = false;
 }
@@ -393,30 +709,73 @@ void MainWindow::toggleGroup(QVector<GraphicsArrowItem*>& g, bool state, bool &
 void MainWindow::on_forceVecsButton_toggled(bool /*checked*/)
 {
     showForcesStateChanged = true;
+    sceneDirty = true;
     refresh(true);
 }
 
 void MainWindow::on_speedVecsButton_toggled(bool /*checked*/)
 {
     showSpeedsStateChanged = true;
+    sceneDirty = true;
     refresh(true);
 }
 
 void MainWindow::on_torquesButton_toggled(bool /*checked*/)
 {
     showTorquesStateChanged = true;
+    sceneDirty = true;
     refresh(true);
 }
 
 void MainWindow::on_totForceButton_toggled(bool /*checked*/)
 {
     showTotForceStateChanged = true;
+    sceneDirty = true;
     refresh(true);
 }
 
 void MainWindow::on_totSpeedButton_toggled(bool /*checked*/)
 {
     showTotSpeedStateChanged = true;
+    sceneDirty = true;
+    refresh(true);
+}
+
+void MainWindow::on_torqueHistoryButton_toggled(bool /*checked*/)
+{
+    sceneDirty = true;
+    refresh(true);
+}
+
+void MainWindow::on_heatmapBox_currentIndexChanged(int index)
+{
+    // The first entry is the plain colour, the rest follow sectionChannel
+    heatChannel = index-1;
+    updateHeatmapRange();
+    sceneDirty = true;
+    refresh(true);
+}
+
+void MainWindow::updateHeatmapRange()
+{
+    if(heatChannel < 0)
+    {
+        return;
+    }
+    if(mlf && readState == READ_STATE_FILE)
+    {
+        heatmap.setRange(mlf->getChannelMin(heatChannel),mlf->getChannelMax(heatChannel));
+    }
+    else
+    {
+        heatmap.clearRange();
+    }
+}
+
+void MainWindow::on_trailButton_toggled(bool /*checked*/)
+{
+    showTrailsStateChanged = true;
+    sceneDirty = true;
     refresh(true);
 }
 
@@ -430,26 +789,330 @@ void MainWindow::openFile()
     {
         return;
     }
+    // The prefetcher, the statistics and the cache read from the file, stop them first
+    delete prefetcher;
+    prefetcher = nullptr;
+    statisticsWatcher.waitForFinished();
+    cacheSaving.waitForFinished();
     if(mlf)
     {
         delete mlf;
         mlf = nullptr;
     }
-    mlf = new matlabFileInterface(fname);
+    {
+        scopedStageTimer loadTimer(profiler,STAGE_LOAD);
+        mlf = new matlabFileInterface(fname);
+    }
+    prefetcher = new framePrefetcher(mlf);
+    // The cache is saved with the statistics once they are ready
+    startStatistics();
+    // Built on the first search, most runs are only watched
+    rangeIndex.clear();
+    rangeIndexStale = true;
+    fileName = fname;
+    ui->findSectionBox->setMaximum(mlf->getNumberOfSections()-1);
+    fileCursor = 0;
     simulationTime = 0;
+    clearLoopRange();
     ui->horizontalSlider->setEnabled(true);
     ui->playButton->setEnabled(true);
+    ui->reverseButton->setEnabled(true);
+    ui->stepBackButton->setEnabled(true);
+    ui->stepForwardButton->setEnabled(true);
+    ui->findNextButton->setEnabled(true);
+    ui->findMaxButton->setEnabled(true);
     ui->timeLabel->setEnabled(true);
 
-    std::vector<snakeSectionData> sections;
-    for(int i = 0; i < mlf->getNumberOfSections(); ++i)
+    mlf->sampleFrame(simulationTime,fileCursor,frame);
+    changeSegments(frame);
+    if(comparison)
     {
-        sections.push_back(mlf->getSection(i));
+        comparison->align(mlf);
+        createGhost();
+    }
+    sceneDirty = true;
+    if(simState == SIM_PLAYING)
+    {
+        restartPrefetch();
     }
-    changeSegments(mlf->getNumberOfSections(),mlf->get_headX(),mlf->get_headY(),mlf->get_headAngle(),sections);
 
     ui->statusBar->showMessage(QString("Reading from file ") + fname);
     readState = READ_STATE_FILE;
+    updateHeatmapRange();
+    updateTailWatch();
+}
+
+void MainWindow::followFile(bool /*follow*/)
+{
+    updateTailWatch();
+    if(ui->actionFollow_file->isChecked())
+    {
+        // Catch up with whatever was written since the file was opened
+        tailTimer.start();
+    }
+}
+
+void MainWindow::updateTailWatch()
+{
+    const bool follow = ui->actionFollow_file->isChecked() && mlf && readState == READ_STATE_FILE;
+    if(!tailWatcher.files().isEmpty())
+    {
+        tailWatcher.removePaths(tailWatcher.files());
+    }
+    if(follow)
+    {
+        tailWatcher.addPath(fileName);
+    }
+    else
+    {
+        tailTimer.stop();
+    }
+}
+
+void MainWindow::fileChanged()
+{
+    // Writers that replace the file make the watcher drop it
+    if(tailWatcher.files().isEmpty())
+    {
+        updateTailWatch();
+    }
+    if(!tailTimer.isActive())
+    {
+        tailTimer.start();
+    }
+}
+
+void MainWindow::readTail()
+{
+    if(!mlf || readState != READ_STATE_FILE || !ui->actionFollow_file->isChecked())
+    {
+        return;
+    }
+    // The statistics and the cache read the samples on the thread pool, try again once they are done
+    if(statisticsWatcher.isRunning() || cacheSaving.isRunning())
+    {
+        tailTimer.start();
+        return;
+    }
+    const float lastTime = mlf->get_lastTime();
+    const bool atEnd = simulationTime >= lastTime;
+    if(prefetcher)
+    {
+        prefetcher->stopAndWait();
+    }
+    int added;
+    {
+        scopedStageTimer loadTimer(profiler,STAGE_LOAD);
+        added = mlf->readAppendedSamples();
+    }
+    if(added > 0)
+    {
+        rangeIndexStale = true;
+        if(comparison)
+        {
+            comparison->align(mlf);
+        }
+        updateHeatmapRange();
+        startStatistics();
+        // Stay at the end of the run while it grows, unless playback is elsewhere
+        if(atEnd && simState == SIM_PAUSED)
+        {
+            simulationTime = mlf->get_lastTime();
+        }
+        updateSlider(mlf->get_lastTime());
+        sceneDirty = true;
+        ui->statusBar->showMessage(QString("Following file ") + fileName + ", " + QString::number(mlf->getNumberOfSamples()) + " samples");
+    }
+    restartPrefetch();
+}
+
+void MainWindow::startStatistics()
+{
+    ui->exportStatisticsButton->setEnabled(false);
+    if(mlf->getNumberOfSamples() == 0)
+    {
+        ui->statisticsOut->setPlainText("No samples in file");
+        return;
+    }
+    ui->statisticsOut->setPlainText("Computing...");
+    statisticsWatcher.setFuture(QtConcurrent::run(&runStatisticsEngine::compute,static_cast<const matlabFileInterface*>(mlf)));
+}
+
+void MainWindow::statisticsReady()
+{
+    statistics = statisticsWatcher.result();
+    QString text = statistics.toText();
+    if(mlf)
+    {
+        text += "\n\n" + mlf->getSampleStore().getSummary();
+    }
+    ui->statisticsOut->setPlainText(text);
+    ui->exportStatisticsButton->setEnabled(true);
+    // Does nothing unless the run had to be parsed. Opening and following wait for the save
+    // before the statistics are computed again, so they stay unchanged meanwhile.
+    if(mlf)
+    {
+        cacheSaving = QtConcurrent::run(mlf,&matlabFileInterface::saveCache,static_cast<const runStatistics*>(&statistics));
+    }
+}
+
+void MainWindow::on_exportStatisticsButton_clicked()
+{
+    QString fname = QFileDialog::getSaveFileName(this,"Export Statistics",QCoreApplication::applicationDirPath(),"CSV Files (*.csv)");
+    if(fname.length() == 0)
+    {
+        return;
+    }
+    QFile out(fname);
+    if(!out.open(QIODevice::WriteOnly | QIODevice::Text))
+    {
+        ui->statusBar->showMessage(QString("Could not write ") + fname);
+        return;
+    }
+    out.write(statistics.toCsv().toUtf8());
+    ui->statusBar->showMessage(QString("Statistics written to ") + fname);
+}
+
+void MainWindow::openEnsemble()
+{
+    QStringList fnames = QFileDialog::getOpenFileNames(this,"Load Ensemble",QCoreApplication::applicationDirPath(), "Simulation Files (*.datf)");
+
+    if(fnames.isEmpty())
+    {
+        return;
+    }
+    if(!ensemble)
+    {
+        ensemble = new snakeEnsemble();
+    }
+    {
+        scopedStageTimer loadTimer(profiler,STAGE_LOAD);
+        ensemble->load(fnames);
+    }
+
+    clearScene();
+    ensembleItem = new GraphicsEnsembleItem(ensemble->size());
+    ensembleItem->setTiled(ui->actionTile_ensemble->isChecked());
+    ensembleItem->setZValue(1.0f);
+    m_graphics->addItem(ensembleItem);
+
+    simulationTime = 0;
+    clearLoopRange();
+    sceneDirty = true;
+    ui->horizontalSlider->setEnabled(true);
+    ui->playButton->setEnabled(true);
+    ui->reverseButton->setEnabled(true);
+    ui->stepBackButton->setEnabled(false);
+    ui->stepForwardButton->setEnabled(false);
+    ui->findNextButton->setEnabled(false);
+    ui->findMaxButton->setEnabled(false);
+    ui->timeLabel->setEnabled(true);
+
+    ui->statusBar->showMessage(QString("Reading ensemble of ") + QString::number(ensemble->size()) + " files");
+    readState = READ_STATE_ENSEMBLE;
+    updateTailWatch();
+}
+
+void MainWindow::tileEnsemble(bool tiled)
+{
+    if(ensembleItem)
+    {
+        ensembleItem->setTiled(tiled);
+        sceneDirty = true;
+    }
+}
+
+void MainWindow::openReference()
+{
+    if(!mlf || readState != READ_STATE_FILE)
+    {
+        ui->statusBar->showMessage("Open a simulation file before its reference");
+        return;
+    }
+    QString fname = QFileDialog::getOpenFileName(this,"Load Reference",QCoreApplication::applicationDirPath(), "Simulation Files (*.datf)");
+    if(fname.length() == 0)
+    {
+        return;
+    }
+    if(!comparison)
+    {
+        comparison = new runComparison();
+    }
+    if(!comparison->load(fname))
+    {
+        ui->statusBar->showMessage(QString("No samples in ") + fname);
+        clearReference();
+        return;
+    }
+    comparison->align(mlf);
+    createGhost();
+    sceneDirty = true;
+    refresh(true);
+}
+
+void MainWindow::clearReference()
+{
+    removeAll(ghostItem);
+    ghostItem = nullptr;
+    delete comparison;
+    comparison = nullptr;
+    ui->diffOut->setText("");
+}
+
+void MainWindow::createGhost()
+{
+    removeAll(ghostItem);
+    ghostItem = new GraphicsEnsembleItem(1);
+    ghostItem->setOpacity(0.4);
+    ghostItem->setZValue(0.9f);
+    m_graphics->addItem(ghostItem);
+}
+
+void MainWindow::updateComparison()
+{
+    if(!comparison || !ghostItem || !comparison->isAligned())
+    {
+        return;
+    }
+    comparison->compare(simulationTime,frame);
+    ghostItem->setPoses(0,comparison->getPoses());
+    ghostItem->updateGeometry();
+    ghostItem->update();
+    ui->diffOut->setText(comparison->getSummary());
+}
+
+void MainWindow::showProfiler(bool show)
+{
+    profiler->reset();
+    profiler->setEnabled(show);
+    overlay->setVisible(show);
+    overlay->raise();
+}
+
+void MainWindow::recordTrace(bool record)
+{
+    if(record)
+    {
+        traceFileName = QFileDialog::getSaveFileName(this,"Record Trace",QCoreApplication::applicationDirPath(),"Chrome Trace Files (*.json)");
+        if(traceFileName.length() == 0)
+        {
+            ui->actionRecord_trace->setChecked(false);
+            return;
+        }
+        traceRecorder::start();
+        ui->statusBar->showMessage(QString("Recording trace to ") + traceFileName);
+    }
+    else if(traceRecorder::isRecording())
+    {
+        if(traceRecorder::stop(traceFileName))
+        {
+            ui->statusBar->showMessage(QString("Trace written to ") + traceFileName);
+        }
+        else
+        {
+            ui->statusBar->showMessage(QString("Could not write ") + traceFileName);
+        }
+    }
 }
 
 void MainWindow::openMmap()
@@ -473,10 +1136,17 @@ void MainWindow::openMmap()
     simState = SIM_PAUSED;
     ui->horizontalSlider->setEnabled(false);
     ui->playButton->setEnabled(false);
+    ui->reverseButton->setEnabled(false);
+    ui->stepBackButton->setEnabled(false);
+    ui->stepForwardButton->setEnabled(false);
+    ui->findNextButton->setEnabled(false);
+    ui->findMaxButton->setEnabled(false);
     ui->timeLabel->setEnabled(false);
 
     ui->statusBar->showMessage(QString("Listening on file ") + fname);
     readState = READ_STATE_MMAP;
+    updateHeatmapRange();
+    updateTailWatch();
 }
 
 void MainWindow::openDefaultMmap()
@@ -484,6 +1154,11 @@ void MainWindow::openDefaultMmap()
     // use *.datm
     ui->horizontalSlider->setEnabled(false);
     ui->playButton->setEnabled(false);
+    ui->reverseButton->setEnabled(false);
+    ui->stepBackButton->setEnabled(false);
+    ui->stepForwardButton->setEnabled(false);
+    ui->findNextButton->setEnabled(false);
+    ui->findMaxButton->setEnabled(false);
     ui->timeLabel->setEnabled(false);
     QString fname("display2Dconnection.datm");
 
@@ -496,64 +1171,229 @@ void MainWindow::openDefaultMmap()
 
     ui->statusBar->showMessage(QString("Listening on file ") + fname);
     readState = READ_STATE_MMAP;
+    updateHeatmapRange();
+    updateTailWatch();
 }
 
 void MainWindow::on_horizontalSlider_sliderMoved(int position)
 {
-    simulationTime = mlf->get_lastTime()*(float(position)/float(SLIDER_MAX_VALUE));
-    mlf->iterateToClosestTimePoint(simulationTime);
-    simulationTime = mlf->get_time();
+    simulationTime = getLastTime()*(float(position)/float(SLIDER_MAX_VALUE));
+    if(prefetcher && readState == READ_STATE_FILE)
+    {
+        prefetcher->seek(simulationTime);
+    }
 }
 
 void MainWindow::on_playButton_clicked()
 {
-    if(simState == SIM_PAUSED)
+    if(simState == SIM_PLAYING && playDirection > 0)
     {
-        simState = SIM_PLAYING;
-        ui->playButton->setText("Pause");
-        beginRt = std::chrono::system_clock::now();
+        pausePlayback();
     }
-    else if(simState == SIM_PLAYING)
+    else
     {
-        simState = SIM_PAUSED;
-        ui->playButton->setText("Play");
-        std::chrono::time_point<std::chrono::system_clock> endRt = std::chrono::system_clock::now();
-        std::chrono::duration<double> elapsed_milliseconds = endRt-beginRt;
-        simulationTime+=float(elapsed_milliseconds.count());
-        ui->horizontalSlider->blockSignals(true);
-        ui->horizontalSlider->setValue(int((simulationTime/mlf->get_lastTime())*float(SLIDER_MAX_VALUE)));
-        ui->horizontalSlider->blockSignals(false);
+        startPlayback(1);
+    }
+}
+
+void MainWindow::on_reverseButton_clicked()
+{
+    if(simState == SIM_PLAYING && playDirection < 0)
+    {
+        pausePlayback();
+    }
+    else
+    {
+        startPlayback(-1);
+    }
+}
+
+void MainWindow::startPlayback(int direction)
+{
+    if(simState == SIM_PLAYING)
+    {
+        // Changing direction, account for the time played so far first
+        advanceSimulationTime(getLastTime());
+    }
+    simState = SIM_PLAYING;
+    playDirection = direction;
+    ui->playButton->setText(direction > 0 ? "Pause" : "Play");
+    ui->reverseButton->setText(direction < 0 ? "Pause" : "Reverse");
+    beginRt = std::chrono::steady_clock::now();
+    restartPrefetch();
+}
+
+void MainWindow::pausePlayback()
+{
+    advanceSimulationTime(getLastTime());
+    simState = SIM_PAUSED;
+    ui->playButton->setText("Play");
+    ui->reverseButton->setText("Reverse");
+    if(prefetcher)
+    {
+        prefetcher->stop();
+    }
+    updateSlider(getLastTime());
+}
+
+void MainWindow::stepSample(int direction)
+{
+    if(!mlf || readState != READ_STATE_FILE)
+    {
+        return;
+    }
+    if(simState == SIM_PLAYING)
+    {
+        pausePlayback();
+    }
+    // The cursor is already at the current sample, so a step is a single move
+    simulationTime = mlf->stepSample(simulationTime,fileCursor,direction);
+    updateSlider(getLastTime());
+}
+
+void MainWindow::ensureRangeIndex()
+{
+    if(rangeIndexStale)
+    {
+        rangeIndex.build(mlf);
+        rangeIndexStale = false;
     }
 }
 
-void MainWindow::displayMCSpeed(bool show, std::vector<snakeSectionData> &sections, GraphicsArrowItem *totSpd)
+void MainWindow::jumpToSample(int sample)
 {
-    std::pair<float,float> pos = getMCSpeedArrowPos(sections);
-    std::pair<float,float> spd = getMCSpeed(sections);
-    totSpd->setPos(pos.first,pos.second);
-    totSpd->modify(spd.first,spd.second,show);
+    if(simState == SIM_PLAYING)
+    {
+        pausePlayback();
+    }
+    simulationTime = mlf->getSampleTime(sample);
+    if(prefetcher)
+    {
+        prefetcher->seek(simulationTime);
+    }
+    updateSlider(getLastTime());
+}
+
+void MainWindow::on_findNextButton_clicked()
+{
+    if(!mlf || readState != READ_STATE_FILE)
+    {
+        return;
+    }
+    ensureRangeIndex();
+    // Search from the sample at or before the current time
+    matlabFileInterface::interpolationParameters p = mlf->locate(simulationTime,fileCursor);
+    int sample = rangeIndex.findNextAbove(ui->findChannelBox->currentIndex(),ui->findSectionBox->value(),
+                                          float(ui->findThresholdBox->value()),p.i1);
+    if(sample < 0)
+    {
+        ui->statusBar->showMessage("No later sample above the threshold");
+        return;
+    }
+    jumpToSample(sample);
+}
+
+void MainWindow::on_findMaxButton_clicked()
+{
+    if(!mlf || readState != READ_STATE_FILE)
+    {
+        return;
+    }
+    ensureRangeIndex();
+    int sample = rangeIndex.findMaximum(ui->findChannelBox->currentIndex(),ui->findSectionBox->value());
+    if(sample >= 0)
+    {
+        jumpToSample(sample);
+    }
+}
+
+void MainWindow::on_stepBackButton_clicked()
+{
+    stepSample(-1);
+}
+
+void MainWindow::on_stepForwardButton_clicked()
+{
+    stepSample(1);
 }
 
-void MainWindow::displayTotalForce(bool show, std::vector<snakeSectionData> &sections, GraphicsArrowItem *totFrc)
+void MainWindow::setLoopBegin()
 {
-    std::pair<float,float> pos = getMCForceArrowPos(sections);
-    std::pair<float,float> frc = getTotalForce(sections);
-    totFrc->setPos(pos.first,pos.second);
-    totFrc->modify(frc.first*5.0f,frc.second*5.0f,show);
+    loopBegin = simulationTime;
+    if(loopEnd >= 0.0f && loopEnd < loopBegin)
+    {
+        loopEnd = -1.0f;
+    }
+}
+
+void MainWindow::setLoopEnd()
+{
+    loopEnd = simulationTime;
+    if(loopEnd < loopBegin)
+    {
+        loopBegin = 0.0f;
+    }
 }
 
-void MainWindow::displayTorque(bool show, std::vector<snakeSectionData> &sections, GraphicsTorqueDisplay *torques)
+void MainWindow::clearLoopRange()
 {
-    std::pair<float,float> pos = getTorqueDisplayPos(sections);
-    float tangentAngle = getSnakeTangent(sections);
-    torques->setPos(pos.first,pos.second);
-    torques->setRotation(tangentAngle*180.0f/3.14f);
-    for(int i = 0; i < sections.size()-1; ++i)
+    loopBegin = 0.0f;
+    loopEnd = -1.0f;
+}
+
+float MainWindow::getFrameStep()
+{
+    // Simulation time covered by one display frame
+    return timeScale/scheduler->getTargetRate();
+}
+
+void MainWindow::restartPrefetch()
+{
+    if(prefetcher && readState == READ_STATE_FILE && simState == SIM_PLAYING)
     {
-        torques->modify(i,sections[i].torque);
+        prefetcher->start(simulationTime,playDirection*getFrameStep());
     }
 }
 
+void MainWindow::displayMCSpeed(bool show, const snakeFrame & frame, GraphicsArrowItem *totSpd, float threshold)
+{
+    std::pair<float,float> pos = getMCSpeedArrowPos(frame);
+    std::pair<float,float> spd = getMCSpeed(frame);
+    updateItemPose(totSpd,pos.first,pos.second,totSpd->rotation(),threshold,0.0f);
+    totSpd->modify(spd.first,spd.second,show,threshold);
+}
+
+void MainWindow::displayTotalForce(bool show, const snakeFrame & frame, GraphicsArrowItem *totFrc, float threshold)
+{
+    std::pair<float,float> pos = getMCForceArrowPos(frame);
+    std::pair<float,float> frc = getTotalForce(frame);
+    updateItemPose(totFrc,pos.first,pos.second,totFrc->rotation(),threshold,0.0f);
+    totFrc->modify(frc.first*5.0f,frc.second*5.0f,show,threshold);
+}
+
+void MainWindow::displayTorque(bool show, const snakeFrame & frame, GraphicsTorqueDisplay *torques, float threshold)
+{
+    const std::vector<snakeSectionData> & sections = frame.sections;
+    std::pair<float,float> pos = getTorqueDisplayPos(frame);
+    float tangentAngle = getSnakeTangent(frame);
+    updateItemPose(torques,pos.first,pos.second,tangentAngle*180.0f/3.14f,threshold,torques->boundingRect().width()*0.5f);
+    torqueValues.resize(sections.size());
+    for(unsigned int i = 0; i < sections.size(); ++i)
+    {
+        torqueValues[i] = sections[i].torque;
+    }
+    torques->setShowHistory(ui->torqueHistoryButton->isChecked());
+    torques->setTorques(torqueValues.data(),std::max(0,int(torqueValues.size())-1),threshold);
+    torques->pushHistory();
+}
+
+void MainWindow::on_rateSpinBox_valueChanged(int rate)
+{
+    scheduler->setTargetRate(float(rate));
+    scheduler->resetStatistics();
+    restartPrefetch();
+}
+
 void MainWindow::on_comboBox_currentIndexChanged(const QString &arg1)
 {
     switch(ui->comboBox->currentIndex())
@@ -584,6 +1424,7 @@ void MainWindow::on_comboBox_currentIndexChanged(const QString &arg1)
     case 8:
         timeScale = 0.1f;
     }
+    restartPrefetch();
 }
 
 
@@ -5,6 +5,18 @@
 #include <QGraphicsScene>
 #include "matlabinterface.h"
 #include "graphicsitems.h"
+#include "ensemble.h"
+#include "framescheduler.h"
+#include "prefetcher.h"
+#include "frameprofiler.h"
+#include "snakelayout.h"
+#include "runstatistics.h"
+#include "rangeindex.h"
+#include "runcomparison.h"
+#include "segmenthash.h"
+#include <QFutureWatcher>
+#include <QFileSystemWatcher>
+#include <QTimer>
 #include <chrono>
 #include <bitset>
 #include "dimensions.h"
@@ -22,11 +34,14 @@ class MainWindow : public QMainWindow
     enum { TorquePerSegmentColor = Qt::red };
     enum { TotalForceColor = Qt::yellow };
     enum { TotalSpeedColor = Qt::blue };
+    enum { HeadTrailColor = Qt::darkCyan };
+    enum { MCTrailColor = Qt::magenta };
 
     enum {
         READ_STATE_NONE,
         READ_STATE_FILE,
-        READ_STATE_MMAP
+        READ_STATE_MMAP,
+        READ_STATE_ENSEMBLE
     };
 
     enum {
@@ -35,17 +50,36 @@ class MainWindow : public QMainWindow
     };
 
     enum { SLIDER_MAX_VALUE = 1000000 };
+    enum { TRAIL_CAPACITY = 4096 };
 
 public:
     explicit MainWindow(QWidget *parent = 0);
     ~MainWindow();
 
+    // Items are only moved when the change is at least this many pixels on screen
+    void setDirtyThreshold(float pixels);
+
+protected:
+    // Follows the mouse over the view for the segment readout
+    bool eventFilter(QObject * watched, QEvent * event);
+
 private:
     static const quint32 REFRESH_INTERVAL_MILLISEC = 20;
+    static constexpr float DEFAULT_DIRTY_THRESHOLD_PIXELS = 0.25f;
     Ui::MainWindow *ui;
     matlabSharedMemoryInterface * mli;
     matlabFileInterface * mlf;
+    framePrefetcher * prefetcher;
+    snakeFrame frame;
+    quint32 fileCursor;
+    float getFrameStep();
+    void restartPrefetch();
+    snakeEnsemble * ensemble;
     QGraphicsScene * m_graphics;
+    FrameScheduler * scheduler;
+    frameProfiler * profiler;
+    profilerOverlay * overlay;
+    QString traceFileName;
     bool exit;
     bool isRefreshing;
     bool isOnFirstIteration;
@@ -55,26 +89,93 @@ private:
 
     float timeScale;
     float simulationTime;
-    std::chrono::time_point<std::chrono::system_clock> beginRt;
+    std::chrono::time_point<std::chrono::steady_clock> beginRt;
     int simState;
+    int playDirection;
+    float loopBegin;
+    float loopEnd;     // Negative for the end of the run
+    void startPlayback(int direction);
+    void pausePlayback();
+    void stepSample(int direction);
+    void updateSlider(float lastTime);
+
+    float dirtyThresholdPixels;
+    float lastRenderedTime;
+    bool sceneDirty;
+    float getSceneThreshold();
+    int getArrowStride();
 
     QVector<GraphicsSegmentItem*> segments;
-    QVector<GraphicsArrowItem*> forces;
-    QVector<GraphicsArrowItem*> speeds;
+    // Stands in for the segments when zoomed out
+    GraphicsSnakeLineItem* snakeLine;
+    GraphicsArrowFieldItem* forceField;
+    GraphicsArrowFieldItem* speedField;
+    std::vector<segmentPose> poses;
+    // Segment under the mouse, looked up in a hash of the poses rebuilt only while hovering
+    segmentHash segmentPicker;
+    bool pickerDirty;
+    bool hovering;
+    QPointF hoverPos;
+    void updateHover();
+    std::vector<float> forceX;
+    std::vector<float> forceY;
+    std::vector<float> speedX;
+    std::vector<float> speedY;
     GraphicsTorqueDisplay* torques;
+    std::vector<float> torqueValues;
+    colorLookupTable heatmap;
+    int heatChannel;
+    void updateHeatmapRange();
     GraphicsArrowItem* totalForce;
     GraphicsArrowItem* totalSpeed;
+    GraphicsTrailItem* headTrail;
+    GraphicsTrailItem* mcTrail;
+    int trailSample;
+    GraphicsEnsembleItem* ensembleItem;
+
+    // Cache of the open file, written on the thread pool with the statistics after loading
+    QFuture<bool> cacheSaving;
+
+    // Whole-run numbers of the open file, computed on the thread pool after loading
+    QFutureWatcher<runStatistics> statisticsWatcher;
+    runStatistics statistics;
+    void startStatistics();
+
+    // Threshold and peak search over the open file, rebuilt on the next search once samples are appended
+    channelRangeIndex rangeIndex;
+    bool rangeIndexStale;
+    void ensureRangeIndex();
+    void jumpToSample(int sample);
+
+    // Follow mode, samples appended to the open file are parsed while it is watched. Changes are
+    // collected for TAIL_DELAY_MILLISEC before the file is read.
+    static const int TAIL_DELAY_MILLISEC = 200;
+    QString fileName;
+    QFileSystemWatcher tailWatcher;
+    QTimer tailTimer;
+    void updateTailWatch();
+
+    // Reference run drawn as a ghost over the primary run
+    runComparison * comparison;
+    GraphicsEnsembleItem* ghostItem;
+    void createGhost();
+    void updateComparison();
 
     float getHeadingAngleOfSnake(const float headAngle, const std::vector<snakeSectionData> & sections);
 
     void removeAll(GraphicsArrowItem *items);
     void removeAll(GraphicsTorqueDisplay* items);
-    void removeAll(QVector<GraphicsArrowItem*>& items);
+    void removeAll(GraphicsTrailItem* items);
+    void removeAll(GraphicsEnsembleItem* items);
+    void removeAll(GraphicsSnakeLineItem* items);
+    void clearScene();
+    void removeAll(GraphicsArrowFieldItem* items);
     void removeAll(QVector<GraphicsSegmentItem*>& items);
 
-    void toggleGroup(QVector<GraphicsArrowItem*>& g, bool state, bool &toggled);
+    void toggleGroup(GraphicsArrowFieldItem* g, bool state, bool &toggled);
     void toggleGroup(GraphicsArrowItem * g, bool state, bool &toggled);
     void toggleGroup(GraphicsTorqueDisplay * g, bool state, bool &toggled);
+    void toggleGroup(GraphicsTrailItem * g, bool state, bool &toggled);
 
 
     bool showForcesStateChanged;
@@ -82,125 +183,23 @@ private:
     bool showTorquesStateChanged;
     bool showTotForceStateChanged;
     bool showTotSpeedStateChanged;
+    bool showTrailsStateChanged;
 
 
-    void changeSegments(const int numberOfSegments, float headX, float headY, float headAngle, std::vector<snakeSectionData> & sections);
-    void updateSegments(const int, float headX, float headY, float headAngle, std::vector<snakeSectionData> &sections);
+    void changeSegments(const snakeFrame & frame);
+    void updateSegments(const snakeFrame & frame);
+    void readSharedMemoryFrame();
 
     void printState();
+    float getLastTime();
+    void advanceSimulationTime(float lastTime);
+
+    void updateFileTrails(const snakeFrame & frame);
+    void updateLiveTrails(const snakeFrame & frame);
 
-    std::pair<float,float> getTotalForce(std::vector<snakeSectionData>& sections)
-    {
-        float rx = 0.0f;
-        float ry = 0.0f;
-        for(unsigned int i = 0; i < sections.size(); ++i)
-        {
-            rx += float(sections[i].f_res_x);
-            ry += float(sections[i].f_res_y);
-        }
-
-        return std::pair<float,float>(rx,ry);
-    }
-
-    std::pair<float,float> getMCSpeed(std::vector<snakeSectionData>& sections)
-    {
-        float rx = 0.0f;
-        float ry = 0.0f;
-        float f = 1.0f/float(sections.size());
-        for(unsigned int i = 0; i < sections.size(); ++i)
-        {
-            rx += f*float(sections[i].dx);
-            ry += f*float(sections[i].dy);
-        }
-
-        return std::pair<float,float>(rx,ry);
-    }
-
-    std::pair<float,float> getMCPos(std::vector<snakeSectionData>& sections)
-    {
-        float rx = 0.0f;
-        float ry = 0.0f;
-        float f = SCALE_ALL_FACTOR*1.0f/float(sections.size());
-        for(unsigned int i = 0; i < sections.size(); ++i)
-        {
-            rx += f*float(sections[i].x);
-            ry += f*float(sections[i].y);
-        }
-
-        return std::pair<float,float>(rx,ry);
-    }
-
-    float getSnakeTangent(std::vector<snakeSectionData>& sections)
-    {
-        // derive this from the forward speed
-        std::pair<float,float> spd = getMCSpeed(sections);
-        float avgtheta = atan2(spd.second,spd.first);
-        return avgtheta;
-    }
-
-    float getSnakeLength(std::vector<snakeSectionData>& sections)
-    {
-        typedef robot_dimensions<SCALE_ALL_FACTOR> RD;
-        float len = 0.0f;
-        for(unsigned int i = 0; i < sections.size(); ++i)
-        {
-            len += RD::segmentMCtoBackwardJointConnection(i) +
-                   RD::segmentMCtoForwardJointConnection(i);
-        }
-        return len;
-    }
-
-    std::pair<float,float> getMCSpeedArrowPos(std::vector<snakeSectionData>& sections)
-    {
-        float len = getSnakeLength(sections);
-        float tangentAngle = getSnakeTangent(sections);
-
-        float normalLen = len*0.3f; // Arbitrary constant, whatever seems fit
-        float normalX = normalLen*cos(tangentAngle+3.14f/2.0f);
-        float normalY = normalLen*sin(tangentAngle+3.14f/2.0f);
-        float tangentOffsetLen = len*0.15f;
-        float tangentX = tangentOffsetLen*cos(tangentAngle);
-        float tangentY = tangentOffsetLen*sin(tangentAngle);
-
-        std::pair<float,float> mcPos = getMCPos(sections);
-
-        return std::pair<float,float>(mcPos.first + normalX + tangentX, mcPos.second + normalY + tangentY);
-    }
-
-    std::pair<float,float> getMCForceArrowPos(std::vector<snakeSectionData>& sections)
-    {
-        float len = getSnakeLength(sections);
-        float tangentAngle = getSnakeTangent(sections);
-
-        float normalLen = len*0.3f; // Arbitrary constant, whatever seems fit
-        float normalX = normalLen*cos(tangentAngle+3.14f/2.0f);
-        float normalY = normalLen*sin(tangentAngle+3.14f/2.0f);
-        float tangentOffsetLen = -1.0f*len*0.15f;
-        float tangentX = tangentOffsetLen*cos(tangentAngle);
-        float tangentY = tangentOffsetLen*sin(tangentAngle);
-
-        std::pair<float,float> mcPos = getMCPos(sections);
-
-        return std::pair<float,float>(mcPos.first + normalX + tangentX, mcPos.second + normalY + tangentY);
-    }
-
-    std::pair<float,float> getTorqueDisplayPos(std::vector<snakeSectionData>& sections)
-    {
-        float len = getSnakeLength(sections);
-        float tangentAngle = getSnakeTangent(sections);
-
-        float normalLen = len*0.4f; // Arbitrary constant, whatever seems fit
-        float normalX = -normalLen*cos(tangentAngle+3.14f/2.0f);
-        float normalY = -normalLen*sin(tangentAngle+3.14f/2.0f);
-
-        std::pair<float,float> mcPos = getMCPos(sections);
-
-        return std::pair<float,float>(mcPos.first + normalX, mcPos.second + normalY);
-    }
-
-    void displayMCSpeed(bool show, std::vector<snakeSectionData>& sections, GraphicsArrowItem* totSpd);
-    void displayTotalForce(bool show, std::vector<snakeSectionData>& sections, GraphicsArrowItem* totFrc);
-    void displayTorque(bool show, std::vector<snakeSectionData>& sections, GraphicsTorqueDisplay* torques);
+    void displayMCSpeed(bool show, const snakeFrame & frame, GraphicsArrowItem* totSpd, float threshold = 0.0f);
+    void displayTotalForce(bool show, const snakeFrame & frame, GraphicsArrowItem* totFrc, float threshold = 0.0f);
+    void displayTorque(bool show, const snakeFrame & frame, GraphicsTorqueDisplay* torques, float threshold = 0.0f);
 
 
 private slots:
@@ -211,12 +210,35 @@ private slots:
     void on_torquesButton_toggled(bool);
     void on_totForceButton_toggled(bool);
     void on_totSpeedButton_toggled(bool);
+    void on_trailButton_toggled(bool);
+    void on_torqueHistoryButton_toggled(bool);
+    void on_heatmapBox_currentIndexChanged(int index);
     void openFile();
     void openMmap();
     void openDefaultMmap();
+    void openEnsemble();
+    void tileEnsemble(bool tiled);
+    void followFile(bool follow);
+    void fileChanged();
+    void readTail();
+    void openReference();
+    void clearReference();
+    void showProfiler(bool show);
+    void recordTrace(bool record);
     void on_horizontalSlider_sliderMoved(int position);
     void on_playButton_clicked();
+    void on_reverseButton_clicked();
+    void on_stepBackButton_clicked();
+    void on_stepForwardButton_clicked();
+    void setLoopBegin();
+    void setLoopEnd();
+    void clearLoopRange();
     void on_comboBox_currentIndexChanged(const QString &arg1);
+    void on_rateSpinBox_valueChanged(int rate);
+    void statisticsReady();
+    void on_exportStatisticsButton_clicked();
+    void on_findNextButton_clicked();
+    void on_findMaxButton_clicked();
 };
 
 #endif // MAINWINDOW_H
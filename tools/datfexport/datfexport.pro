@@ -0,0 +1,26 @@
+#-------------------------------------------------
+#
+# Exporter of .datf channels to CSV or raw float32
+#
+# Run ./datfexport [options] file.datf output, see --help
+#
+#-------------------------------------------------
+
+QT       += core concurrent
+QT       -= gui
+
+CONFIG += c++11
+CONFIG += console
+CONFIG -= app_bundle
+
+gcc:QMAKE_CXXFLAGS += -fno-math-errno
+
+TARGET = datfexport
+TEMPLATE = app
+
+include(../../core/core.pri)
+
+SOURCES += main.cpp
+
+HEADERS  += exportformatter.h \
+    floatformat.h
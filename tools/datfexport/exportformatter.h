@@ -0,0 +1,214 @@
+#ifndef EXPORTFORMATTER_H
+#define EXPORTFORMATTER_H
+
+#include <QByteArray>
+#include <QtEndian>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include "simdkernels.h"
+#include "floatformat.h"
+
+// A float at a fixed byte offset in every record of a .datf
+struct exportColumn
+{
+    QByteArray name;
+    int offset;
+};
+
+// What is exported of a .datf: the time and then the columns, one row per sample or per step of a
+// time grid
+struct exportSettings
+{
+    std::vector<exportColumn> columns;
+    qint64 recordBytes;
+    double begin;           // Seconds, only rows within [begin,end] are exported
+    double end;
+    double rate;            // Rows per second interpolated from the samples, 0 exports the samples
+    bool csv;               // Otherwise little endian float32 rows
+    int digits;             // Significant digits of CSV values
+
+    exportSettings() :
+        recordBytes(0),
+        begin(-HUGE_VAL),
+        end(HUGE_VAL),
+        rate(0.0),
+        csv(true),
+        digits(9)
+    {
+    }
+
+    // Size of a row in the output at most
+    qint64 getRowBytes() const
+    {
+        const qint64 values = qint64(columns.size())+1;
+        return csv ? values*(MAX_FLOAT_CHARS+1) : values*4;
+    }
+
+    // Time of step row of the grid
+    double getGridTime(qint64 row) const
+    {
+        return begin + double(row)/rate;
+    }
+
+    // First step of the grid at or after t, or after t if strictly. Rounding the product alone
+    // could drop a step that lands on t.
+    qint64 getStepAfter(double t, bool strictly) const
+    {
+        qint64 step = qint64(std::ceil((t-begin)*rate));
+        while(strictly ? getGridTime(step-1) > t : getGridTime(step-1) >= t)
+        {
+            --step;
+        }
+        while(strictly ? getGridTime(step) <= t : getGridTime(step) < t)
+        {
+            ++step;
+        }
+        return std::max(Q_INT64_C(0),step);
+    }
+};
+
+// Consecutive records of a .datf and the rows formatted from them
+struct exportChunk
+{
+    const exportSettings * settings;
+    QByteArray records;
+    qint64 firstRow;        // With a rate, steps [firstRow,lastRow) of the grid within the records
+    qint64 lastRow;
+    QByteArray data;
+    qint64 rows;
+};
+
+inline float readFloat(const char * p)
+{
+    const quint32 bits = qFromLittleEndian<quint32>(reinterpret_cast<const uchar*>(p));
+    float v;
+    std::memcpy(&v,&bits,4);
+    return v;
+}
+
+// Formats the rows of a chunk. The records are only read, any number of chunks can be formatted
+// at once.
+class exportFormatter
+{
+public:
+    exportFormatter(const exportSettings & settings) :
+        s(settings),
+        columns(int(settings.columns.size()))
+    {
+    }
+
+    void format(exportChunk & c)
+    {
+        const qint64 records = c.records.size()/s.recordBytes;
+        const qint64 rows = s.rate > 0.0 ? c.lastRow-c.firstRow : records;
+        c.data.resize(int(rows*s.getRowBytes()));
+        c.rows = 0;
+        char * out = c.data.data();
+        std::vector<float> row(size_t(columns)+1);
+        if(s.rate > 0.0)
+        {
+            out = interpolate(c,records,row,out);
+        }
+        else
+        {
+            for(qint64 i = 0; i < records; ++i)
+            {
+                const char * r = getRecord(c,i);
+                const float t = readFloat(r);
+                if(t < s.begin || t > s.end)
+                {
+                    continue;
+                }
+                gather(r,row.data()+1);
+                row[0] = t;
+                out = writeRow(row.data(),out);
+                ++c.rows;
+            }
+        }
+        c.data.resize(int(out-c.data.data()));
+    }
+
+private:
+    const char * getRecord(const exportChunk & c, qint64 i) const
+    {
+        return c.records.constData() + i*s.recordBytes;
+    }
+
+    void gather(const char * r, float * values) const
+    {
+        for(int i = 0; i < columns; ++i)
+        {
+            values[i] = readFloat(r+s.columns[i].offset);
+        }
+    }
+
+    // Rows of the grid steps of the chunk, each between the two samples around it
+    char * interpolate(exportChunk & c, qint64 records, std::vector<float> & row, char * out)
+    {
+        std::vector<float> a(columns);
+        std::vector<float> b(columns);
+        qint64 i1 = 0;
+        qint64 i2 = std::min(Q_INT64_C(1),records-1);
+        gather(getRecord(c,i1),a.data());
+        gather(getRecord(c,i2),b.data());
+        for(qint64 step = c.firstRow; step < c.lastRow; ++step)
+        {
+            const double t = s.getGridTime(step);
+            const qint64 previous = i1;
+            while(i1+1 < records && readFloat(getRecord(c,i1+1)) <= t)
+            {
+                ++i1;
+            }
+            if(i1 != previous)
+            {
+                i2 = std::min(i1+1,records-1);
+                gather(getRecord(c,i1),a.data());
+                gather(getRecord(c,i2),b.data());
+            }
+            const double t1 = readFloat(getRecord(c,i1));
+            const double t2 = readFloat(getRecord(c,i2));
+            const float scale = t2 > t1 ? float(std::min(1.0,std::max(0.0,(t-t1)/(t2-t1)))) : 0.0f;
+            getSimdKernels().interpolate(a.data(),b.data(),scale,row.data()+1,columns);
+            row[0] = float(t);
+            out = writeRow(row.data(),out);
+            ++c.rows;
+        }
+        return out;
+    }
+
+    char * writeRow(const float * values, char * out) const
+    {
+        if(!s.csv)
+        {
+            for(int i = 0; i <= columns; ++i)
+            {
+                quint32 bits;
+                std::memcpy(&bits,values+i,4);
+                qToLittleEndian(bits,reinterpret_cast<uchar*>(out));
+                out += 4;
+            }
+            return out;
+        }
+        out = formatFloat(values[0],s.digits,out);
+        for(int i = 1; i <= columns; ++i)
+        {
+            *out++ = ',';
+            out = formatFloat(values[i],s.digits,out);
+        }
+        *out++ = '\n';
+        return out;
+    }
+
+    const exportSettings & s;
+    const int columns;
+};
+
+inline void formatChunk(exportChunk & c)
+{
+    exportFormatter formatter(*c.settings);
+    formatter.format(c);
+}
+
+#endif // EXPORTFORMATTER_H
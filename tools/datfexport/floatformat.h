@@ -0,0 +1,138 @@
+#ifndef FLOATFORMAT_H
+#define FLOATFORMAT_H
+
+#include <cmath>
+#include <cstring>
+#include <QtGlobal>
+
+// Writes v like printf("%.*g",digits,v) with digits from 1 to 9 and returns the end of the text, at
+// most MAX_FLOAT_CHARS long. Nine digits read back as the same float. Rounds in double precision
+// instead of exactly, so a rare near tie in the last digit may differ from printf. NaN is nan.
+enum { MAX_FLOAT_CHARS = 15 };
+
+inline double getPowerOfTen(int e)
+{
+    // Every float with up to nine digits stays within 10^-54 to 10^54
+    struct table
+    {
+        double p[109];
+        table()
+        {
+            for(int i = 0; i < 109; ++i)
+            {
+                p[i] = std::pow(10.0,i-54);
+            }
+        }
+    };
+    static const table t;
+    return t.p[e+54];
+}
+
+inline char * formatFloat(float v, int digits, char * out)
+{
+    if(std::isnan(v))
+    {
+        std::memcpy(out,"nan",3);
+        return out+3;
+    }
+    if(v < 0.0f || (v == 0.0f && std::signbit(v)))
+    {
+        *out++ = '-';
+        v = -v;
+    }
+    if(std::isinf(v))
+    {
+        std::memcpy(out,"inf",3);
+        return out+3;
+    }
+    if(v == 0.0f)
+    {
+        *out++ = '0';
+        return out;
+    }
+    static const quint64 limits[10] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000 };
+    const double d = v;
+    int b = 0;
+    std::frexp(d,&b);
+    int e = int(std::floor((b-1)*0.30102999566398120));
+    while(d >= getPowerOfTen(e+1))
+    {
+        ++e;
+    }
+    while(d < getPowerOfTen(e))
+    {
+        --e;
+    }
+    // Ties round to even like printf, they are exact in double when they occur
+    const double scaled = d*getPowerOfTen(digits-1-e);
+    quint64 m = quint64(scaled);
+    const double rest = scaled - double(m);
+    if(rest > 0.5 || (rest == 0.5 && (m & 1)))
+    {
+        ++m;
+    }
+    if(m >= limits[digits])
+    {
+        m /= 10;
+        ++e;
+    }
+    int n = digits;
+    while(n > 1 && m % 10 == 0)
+    {
+        m /= 10;
+        --n;
+    }
+    char text[9] = {};
+    for(int i = n-1; i >= 0; --i)
+    {
+        text[i] = char('0' + m % 10);
+        m /= 10;
+    }
+    if(e < -4 || e >= digits)
+    {
+        *out++ = text[0];
+        if(n > 1)
+        {
+            *out++ = '.';
+            std::memcpy(out,text+1,n-1);
+            out += n-1;
+        }
+        *out++ = 'e';
+        *out++ = e < 0 ? '-' : '+';
+        const int a = e < 0 ? -e : e;
+        if(a >= 100)
+        {
+            *out++ = char('0' + a/100);
+        }
+        *out++ = char('0' + a/10 % 10);
+        *out++ = char('0' + a % 10);
+    }
+    else if(e >= 0)
+    {
+        const int whole = e+1;
+        for(int i = 0; i < whole; ++i)
+        {
+            *out++ = i < n ? text[i] : '0';
+        }
+        if(n > whole)
+        {
+            *out++ = '.';
+            std::memcpy(out,text+whole,n-whole);
+            out += n-whole;
+        }
+    }
+    else
+    {
+        *out++ = '0';
+        *out++ = '.';
+        for(int i = -1; i > e; --i)
+        {
+            *out++ = '0';
+        }
+        std::memcpy(out,text,n);
+        out += n;
+    }
+    return out;
+}
+
+#endif // FLOATFORMAT_H
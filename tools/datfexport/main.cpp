@@ -0,0 +1,388 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QFile>
+#include <QTextStream>
+#include <QThread>
+#include <QtConcurrent/QtConcurrent>
+#include <chrono>
+#include <vector>
+#include "matlabinterface.h"
+#include "exportformatter.h"
+
+// Records are read and rows formatted in chunks of about this many bytes
+static const qint64 CHUNK_BYTES = 1 << 20;
+
+static const char * const headChannels[] = { "head_x", "head_y", "head_angle" };
+static const char * const sectionChannels[] = { "x", "y", "phi", "dx", "dy", "d_phi", "f_res_x", "f_res_y", "torque" };
+
+static float readTime(QFile & in, qint64 recordBytes, qint64 record)
+{
+    char t[4];
+    if(!in.seek(matlabFileInterface::HEADER_BYTES + record*recordBytes) || in.read(t,4) != 4)
+    {
+        return 0.0f;
+    }
+    return readFloat(t);
+}
+
+// First record at or after t, the records are in time order
+static qint64 findRecord(QFile & in, qint64 recordBytes, qint64 samples, double t)
+{
+    qint64 first = 0;
+    qint64 last = samples;
+    while(first < last)
+    {
+        const qint64 middle = first + (last-first)/2;
+        if(readTime(in,recordBytes,middle) < t)
+        {
+            first = middle+1;
+        }
+        else
+        {
+            last = middle;
+        }
+    }
+    return first;
+}
+
+// Reads the records of the time range in blocks and hands them out as chunks. With a rate a block
+// starts with the last record of the previous one, so every grid step lies between two records of
+// one block, and a block with more steps than fit a chunk is handed out as several chunks.
+class chunkReader
+{
+public:
+    chunkReader(QFile & in, const exportSettings & settings, qint64 first, qint64 samples) :
+        in(in),
+        s(settings),
+        nextRecord(first),
+        samples(samples),
+        finished(false),
+        error(false),
+        row(0),
+        blockEndRow(0)
+    {
+        const qint64 rowBytes = s.getRowBytes();
+        recordsPerBlock = std::max(Q_INT64_C(1),CHUNK_BYTES/(s.rate > 0.0 ? s.recordBytes : std::max(s.recordBytes,rowBytes)));
+        rowsPerChunk = std::max(Q_INT64_C(1),CHUNK_BYTES/rowBytes);
+        in.seek(matlabFileInterface::HEADER_BYTES + first*s.recordBytes);
+    }
+
+    bool next(exportChunk & c)
+    {
+        if(s.rate <= 0.0)
+        {
+            if(!readBlock())
+            {
+                return false;
+            }
+            c.records = block;
+            return true;
+        }
+        while(row >= blockEndRow)
+        {
+            if(!readBlock())
+            {
+                return false;
+            }
+        }
+        c.records = block;
+        c.firstRow = row;
+        c.lastRow = std::min(blockEndRow,row+rowsPerChunk);
+        row = c.lastRow;
+        return true;
+    }
+
+    bool failed() const
+    {
+        return error;
+    }
+
+private:
+    bool readBlock()
+    {
+        const qint64 count = std::min(recordsPerBlock,samples-nextRecord);
+        if(finished || count <= 0)
+        {
+            return false;
+        }
+        const qint64 carried = s.rate > 0.0 && !block.isEmpty() ? s.recordBytes : 0;
+        QByteArray b(int(carried + count*s.recordBytes),Qt::Uninitialized);
+        std::memcpy(b.data(),block.constData()+block.size()-carried,size_t(carried));
+        if(in.read(b.data()+carried,count*s.recordBytes) != count*s.recordBytes)
+        {
+            error = true;
+            finished = true;
+            return false;
+        }
+        block = b;
+        nextRecord += count;
+        const double firstTime = readFloat(block.constData());
+        const double lastTime = readFloat(block.constData()+block.size()-s.recordBytes);
+        finished = nextRecord >= samples || lastTime > s.end || (s.rate > 0.0 && lastTime >= s.end);
+        if(s.rate > 0.0)
+        {
+            // The step at lastTime belongs to the next block unless there is none
+            row = std::max(row,s.getStepAfter(firstTime,false));
+            blockEndRow = finished ? s.getStepAfter(std::min(lastTime,s.end),true) : s.getStepAfter(lastTime,false);
+        }
+        return true;
+    }
+
+    QFile & in;
+    const exportSettings & s;
+    qint64 nextRecord;
+    qint64 samples;
+    qint64 recordsPerBlock;
+    qint64 rowsPerChunk;
+    bool finished;
+    bool error;
+    QByteArray block;
+    qint64 row;
+    qint64 blockEndRow;
+};
+
+// Reads batches of chunks while the previous batch is formatted on the thread pool and written,
+// so at most two batches are in memory and the rows leave in order
+static bool writeExport(chunkReader & reader, const exportSettings & settings, QIODevice & out, qint64 & rows, qint64 & bytes)
+{
+    const int chunksPerBatch = std::max(1,QThread::idealThreadCount()*2);
+    std::vector<exportChunk> batches[2];
+    QFuture<void> pending;
+    bool formatting = false;
+    bool reading = true;
+    int current = 0;
+    bool ok = true;
+    while(reading || formatting)
+    {
+        std::vector<exportChunk> & batch = batches[current];
+        batch.clear();
+        while(reading && int(batch.size()) < chunksPerBatch)
+        {
+            exportChunk c;
+            c.settings = &settings;
+            c.firstRow = 0;
+            c.lastRow = 0;
+            c.rows = 0;
+            reading = reader.next(c);
+            if(reading)
+            {
+                batch.push_back(c);
+            }
+        }
+        pending.waitForFinished();
+        const bool written = formatting;
+        formatting = !batch.empty();
+        if(formatting)
+        {
+            pending = QtConcurrent::map(batch,formatChunk);
+        }
+        if(written)
+        {
+            std::vector<exportChunk> & done = batches[1-current];
+            for(unsigned int i = 0; i < done.size() && ok; ++i)
+            {
+                ok = out.write(done[i].data) == done[i].data.size();
+                rows += done[i].rows;
+                bytes += done[i].data.size();
+            }
+            done.clear();
+        }
+        current = 1-current;
+        if(!ok)
+        {
+            pending.waitForFinished();
+            return false;
+        }
+    }
+    return !reader.failed();
+}
+
+static int findName(const char * const * names, int count, const QString & name)
+{
+    for(int i = 0; i < count; ++i)
+    {
+        if(name == QLatin1String(names[i]))
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Parses a list like 3-7,12 of sections below sections
+static bool parseSections(const QString & list, quint32 sections, std::vector<quint32> & out)
+{
+    const QStringList ranges = list.split(',',Qt::SkipEmptyParts);
+    for(int r = 0; r < ranges.size(); ++r)
+    {
+        const QStringList ends = ranges[r].trimmed().split('-');
+        bool ok = false;
+        bool valid = true;
+        const quint32 first = ends[0].toUInt(&ok);
+        const quint32 last = ends.size() == 2 ? ends[1].toUInt(&valid) : first;
+        if(!ok || !valid || ends.size() > 2 || first > last || last >= sections)
+        {
+            return false;
+        }
+        for(quint32 i = first; i <= last; ++i)
+        {
+            out.push_back(i);
+        }
+    }
+    return !out.empty();
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Exports channels of a .datf as CSV or raw float32 rows. A row is the time and "
+                                     "then the head channels and the section channels of every section in turn.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("file","The .datf file to read.");
+    parser.addPositionalArgument("output","The file to write, - for standard output.");
+    parser.addOptions({
+        {"channels", "Channels to export: head_x, head_y, head_angle, x, y, phi, dx, dy, d_phi, f_res_x, f_res_y "
+                     "and torque.", "list", "x,y,phi,dx,dy,d_phi,f_res_x,f_res_y,torque"},
+        {"sections", "Sections to export, numbered from 0, e.g. 3-7,12. All by default.", "list"},
+        {"begin", "Start of the time range.", "s"},
+        {"end", "End of the time range.", "s"},
+        {"rate", "Rows per second interpolated from the samples, 0 exports the samples.", "hz", "0"},
+        {"format", "csv or raw, little endian float32 rows without a header.", "format", "csv"},
+        {"digits", "Significant digits of CSV values, 9 reads back exactly.", "count", "9"}
+    });
+    parser.process(a);
+
+    QTextStream err(stderr);
+    const QStringList files = parser.positionalArguments();
+    exportSettings settings;
+    bool ok = files.size() == 2;
+    bool valid = true;
+    if(parser.isSet("begin"))
+    {
+        settings.begin = parser.value("begin").toDouble(&valid);
+        ok = ok && valid;
+    }
+    if(parser.isSet("end"))
+    {
+        settings.end = parser.value("end").toDouble(&valid);
+        ok = ok && valid && settings.end >= settings.begin;
+    }
+    settings.rate = parser.value("rate").toDouble(&valid);
+    ok = ok && valid && settings.rate >= 0.0;
+    settings.csv = parser.value("format") == "csv";
+    ok = ok && (settings.csv || parser.value("format") == "raw");
+    settings.digits = parser.value("digits").toInt(&valid);
+    ok = ok && valid && settings.digits >= 1 && settings.digits <= 9;
+    std::vector<int> head;
+    std::vector<int> section;
+    const QStringList channels = parser.value("channels").split(',',Qt::SkipEmptyParts);
+    for(int i = 0; i < channels.size(); ++i)
+    {
+        const QString name = channels[i].trimmed();
+        const int h = findName(headChannels,3,name);
+        const int c = findName(sectionChannels,9,name);
+        if(h >= 0)
+        {
+            head.push_back(h);
+        }
+        else if(c >= 0)
+        {
+            section.push_back(c);
+        }
+        ok = ok && (h >= 0 || c >= 0);
+    }
+    ok = ok && !channels.isEmpty();
+    if(!ok)
+    {
+        err << "Invalid arguments, see --help" << Qt::endl;
+        return 1;
+    }
+
+    QFile in(files[0]);
+    uchar header[matlabFileInterface::HEADER_BYTES];
+    if(!in.open(QIODevice::ReadOnly) || in.read(reinterpret_cast<char*>(header),sizeof(header)) != qint64(sizeof(header)))
+    {
+        err << "Could not read " << files[0] << Qt::endl;
+        return 1;
+    }
+    const quint32 sectionCount = qFromLittleEndian<quint32>(header);
+    settings.recordBytes = qint64(sizeof(fileRecord)) + qint64(sectionCount)*qint64(sizeof(snakeSectionData));
+    // Like the display, only the complete records of a file that is still being written are read
+    const qint64 samples = std::min(qint64(qFromLittleEndian<quint32>(header+4)),
+                                    (in.size()-matlabFileInterface::HEADER_BYTES)/settings.recordBytes);
+    std::vector<quint32> selected;
+    if(!parser.isSet("sections"))
+    {
+        for(quint32 i = 0; i < sectionCount; ++i)
+        {
+            selected.push_back(i);
+        }
+    }
+    else if(!parseSections(parser.value("sections"),sectionCount,selected))
+    {
+        err << "Invalid sections, the file has " << sectionCount << Qt::endl;
+        return 1;
+    }
+    for(unsigned int i = 0; i < head.size(); ++i)
+    {
+        settings.columns.push_back({headChannels[head[i]],int(sizeof(float))*(head[i]+1)});
+    }
+    for(unsigned int i = 0; i < selected.size(); ++i)
+    {
+        for(unsigned int c = 0; c < section.size(); ++c)
+        {
+            const QByteArray name = QByteArray(sectionChannels[section[c]]) + "_" + QByteArray::number(selected[i]);
+            settings.columns.push_back({name,int(sizeof(fileRecord) + selected[i]*sizeof(snakeSectionData)) + int(sizeof(float))*section[c]});
+        }
+    }
+    qint64 first = 0;
+    if(samples > 0)
+    {
+        first = findRecord(in,settings.recordBytes,samples,settings.begin);
+        if(settings.rate > 0.0)
+        {
+            // The grid starts at the first sample unless a begin is given, the sample before it is
+            // needed to interpolate the first step
+            if(!parser.isSet("begin"))
+            {
+                settings.begin = readTime(in,settings.recordBytes,0);
+            }
+            first = std::max(Q_INT64_C(0),first-1);
+        }
+    }
+
+    QFile out(files[1]);
+    const bool opened = files[1] == "-" ? out.open(stdout,QIODevice::WriteOnly) :
+                                          out.open(QIODevice::WriteOnly | QIODevice::Truncate);
+    if(!opened)
+    {
+        err << "Could not write " << files[1] << Qt::endl;
+        return 1;
+    }
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    qint64 bytes = 0;
+    if(settings.csv)
+    {
+        QByteArray names = "t";
+        for(unsigned int i = 0; i < settings.columns.size(); ++i)
+        {
+            names += "," + settings.columns[i].name;
+        }
+        names += "\n";
+        bytes = out.write(names);
+    }
+    chunkReader reader(in,settings,first,samples);
+    qint64 rows = 0;
+    if(bytes < 0 || !writeExport(reader,settings,out,rows,bytes) || !out.flush())
+    {
+        err << "Could not export " << files[0] << " to " << files[1] << Qt::endl;
+        return 1;
+    }
+    const float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now()-start).count();
+    const double megabytes = double(bytes)/(1 << 20);
+    err << "Exported " << rows << " rows of " << int(settings.columns.size())+1 << " columns, " << megabytes << " MB in "
+        << seconds << " s (" << (seconds > 0.0f ? megabytes/seconds : 0.0) << " MB/s)" << Qt::endl;
+    return 0;
+}
@@ -0,0 +1,25 @@
+#-------------------------------------------------
+#
+# Generator of synthetic .datf recordings
+#
+# Run ./datfgen [options] file.datf, see --help
+#
+#-------------------------------------------------
+
+QT       += core concurrent
+QT       -= gui
+
+CONFIG += c++11
+CONFIG += console
+CONFIG -= app_bundle
+
+gcc:QMAKE_CXXFLAGS += -fno-math-errno
+
+TARGET = datfgen
+TEMPLATE = app
+
+include(../../core/core.pri)
+
+SOURCES += main.cpp
+
+HEADERS  += serpenoid.h
@@ -0,0 +1,149 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QFile>
+#include <QTextStream>
+#include <QThread>
+#include <QtConcurrent/QtConcurrent>
+#include <chrono>
+#include <vector>
+#include "serpenoid.h"
+
+// Samples are generated in chunks of this many bytes at most
+static const qint64 CHUNK_BYTES = 8 << 20;
+
+struct chunk
+{
+    const serpenoidGait * gait;
+    quint64 first;
+    quint64 last;
+    QByteArray data;
+};
+
+static void generateChunk(chunk & c)
+{
+    serpenoidGenerator generator(*c.gait);
+    generator.generate(c.first,c.last,c.data);
+}
+
+// Generates batches of chunks on the thread pool while the previous batch is written, so at
+// most two batches are in memory and the disk is kept busy
+static bool writeDatf(const QString & fileName, const serpenoidGait & gait)
+{
+    QFile out(fileName);
+    if(!out.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        return false;
+    }
+    uchar header[8];
+    qToLittleEndian(gait.sections,header);
+    qToLittleEndian(quint32(gait.samples),header+4);
+    out.write(reinterpret_cast<const char*>(header),8);
+
+    const quint64 samplesPerChunk = quint64(std::max<qint64>(1,CHUNK_BYTES/gait.getSampleBytes()));
+    const int chunksPerBatch = std::max(1,QThread::idealThreadCount()*2);
+    std::vector<chunk> batches[2];
+    QFuture<void> pending;
+    bool generating = false;
+    int current = 0;
+    quint64 next = 0;
+    bool ok = true;
+    while(next < gait.samples || generating)
+    {
+        // Queue the next batch before writing the one that is done
+        std::vector<chunk> & batch = batches[current];
+        batch.clear();
+        for(int i = 0; i < chunksPerBatch && next < gait.samples; ++i)
+        {
+            chunk c;
+            c.gait = &gait;
+            c.first = next;
+            c.last = std::min(gait.samples,next+samplesPerChunk);
+            batch.push_back(c);
+            next = c.last;
+        }
+        pending.waitForFinished();
+        const bool written = generating;
+        generating = !batch.empty();
+        if(generating)
+        {
+            pending = QtConcurrent::map(batch,generateChunk);
+        }
+        if(written)
+        {
+            std::vector<chunk> & done = batches[1-current];
+            for(unsigned int i = 0; i < done.size() && ok; ++i)
+            {
+                ok = out.write(done[i].data) == done[i].data.size();
+            }
+            done.clear();
+        }
+        current = 1-current;
+        if(!ok)
+        {
+            pending.waitForFinished();
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Writes a synthetic .datf of a snake robot following a serpenoid gait.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("file","The .datf file to write.");
+    serpenoidGait defaults;
+    parser.addOptions({
+        {"sections", "Number of sections.", "count", QString::number(defaults.sections)},
+        {"samples", "Number of samples.", "count", QString::number(defaults.samples)},
+        {"rate", "Samples per second.", "hz", QString::number(defaults.sampleRate)},
+        {"amplitude", "Amplitude of the joint angles.", "rad", QString::number(defaults.amplitude)},
+        {"frequency", "Frequency of the gait.", "hz", QString::number(defaults.frequency)},
+        {"phase-offset", "Phase between neighbouring joints.", "rad", QString::number(defaults.phaseOffset)},
+        {"turn", "Offset added to every joint angle.", "rad", QString::number(defaults.turn)},
+        {"speed", "Forward speed of the head.", "m/s", QString::number(defaults.speed)}
+    });
+    parser.process(a);
+
+    QTextStream out(stdout);
+    const QStringList files = parser.positionalArguments();
+    serpenoidGait gait;
+    bool ok = files.size() == 1;
+    bool valid = true;
+    gait.sections = parser.value("sections").toUInt(&valid);
+    ok = ok && valid && gait.sections > 0;
+    gait.samples = parser.value("samples").toULongLong(&valid);
+    ok = ok && valid && gait.samples > 0 && gait.samples <= 0xffffffffull;
+    gait.sampleRate = parser.value("rate").toFloat(&valid);
+    ok = ok && valid && gait.sampleRate > 0.0f;
+    gait.amplitude = parser.value("amplitude").toFloat(&valid);
+    ok = ok && valid;
+    gait.frequency = parser.value("frequency").toFloat(&valid);
+    ok = ok && valid;
+    gait.phaseOffset = parser.value("phase-offset").toFloat(&valid);
+    ok = ok && valid;
+    gait.turn = parser.value("turn").toFloat(&valid);
+    ok = ok && valid;
+    gait.speed = parser.value("speed").toFloat(&valid);
+    ok = ok && valid;
+    if(!ok)
+    {
+        out << "Invalid arguments, see --help" << Qt::endl;
+        return 1;
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    if(!writeDatf(files[0],gait))
+    {
+        out << "Could not write " << files[0] << Qt::endl;
+        return 1;
+    }
+    const float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now()-start).count();
+    const double megabytes = double(8 + gait.samples*gait.getSampleBytes())/(1 << 20);
+    out << "Wrote " << megabytes << " MB to " << files[0] << " in " << seconds << " s ("
+        << (seconds > 0.0f ? megabytes/seconds : 0.0) << " MB/s)" << Qt::endl;
+    return 0;
+}
@@ -0,0 +1,154 @@
+#ifndef SERPENOID_H
+#define SERPENOID_H
+
+#include <QByteArray>
+#include <QtEndian>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include "matlabinterface.h"
+#include "kinematics.h"
+
+// Parameters of a serpenoid gait, joint i follows amplitude*sin(2*pi*frequency*t + i*phaseOffset) + turn
+struct serpenoidGait
+{
+    quint32 sections;
+    quint64 samples;
+    float sampleRate;       // Hz
+    float amplitude;        // rad
+    float frequency;        // Hz
+    float phaseOffset;      // rad between neighbouring joints
+    float turn;             // rad added to every joint, curves the path
+    float speed;            // Forward speed of the head, m/s
+    float friction;         // Resultant force per unit of section speed
+    float stiffness;        // Torque per rad of joint angle
+
+    serpenoidGait() :
+        sections(10),
+        samples(10000),
+        sampleRate(100.0f),
+        amplitude(0.5f),
+        frequency(0.5f),
+        phaseOffset(0.7f),
+        turn(0.0f),
+        speed(0.05f),
+        friction(2.0f),
+        stiffness(1.5f)
+    {
+    }
+
+    // Size of a sample in the file: time, head x, y, angle and then all sections
+    qint64 getSampleBytes() const
+    {
+        return qint64(4 + 9*sections)*4;
+    }
+};
+
+// Writes samples [first,last) of a gait into a buffer in the little endian .datf layout. The state
+// of a sample only depends on its time, so any range can be generated on its own.
+class serpenoidGenerator
+{
+public:
+    serpenoidGenerator(const serpenoidGait & gait) :
+        gait(gait)
+    {
+    }
+
+    void generate(quint64 first, quint64 last, QByteArray & out)
+    {
+        out.resize(int((last-first)*gait.getSampleBytes()));
+        uchar * p = reinterpret_cast<uchar*>(out.data());
+        // The shape of the body only depends on the phase, which is kept in double and wrapped so
+        // it stays exact in long runs. Velocities are the forward speed plus central differences
+        // of the shape over a fraction of the sample period, both small numbers in float.
+        const double w = 2.0*3.14159265358979*gait.frequency;
+        const double h = 0.1/gait.sampleRate;
+        for(quint64 i = first; i < last; ++i)
+        {
+            const double t = double(i)/double(gait.sampleRate);
+            const double phase = getPhase(t);
+            shape(phase,now,nowHead);
+            shape(phase+w*h,ahead,aheadHead);
+            shape(phase-w*h,behind,behindHead);
+            const float headX = float(gait.speed*t);
+            put(p,float(t));
+            put(p,headX);
+            put(p,nowHead.y);
+            put(p,nowHead.rot);
+            for(quint32 j = 0; j < gait.sections; ++j)
+            {
+                const float dx = gait.speed + float((ahead[j].x-behind[j].x)/(2.0*h));
+                const float dy = float((ahead[j].y-behind[j].y)/(2.0*h));
+                const float phi = getJointAngle(phase,j);
+                const float dphi = j+1 < gait.sections ? float(gait.amplitude*w*std::cos(phase + j*gait.phaseOffset)) : 0.0f;
+                put(p,headX + now[j].x);
+                put(p,now[j].y);
+                put(p,phi);
+                put(p,dx);
+                put(p,dy);
+                put(p,dphi);
+                put(p,-gait.friction*dx);
+                put(p,-gait.friction*dy);
+                put(p,-gait.stiffness*phi);
+            }
+        }
+    }
+
+private:
+    // Phase of the gait at time t in [0,2*pi)
+    double getPhase(double t) const
+    {
+        const double period = 2.0*3.14159265358979;
+        const double phase = std::fmod(period*gait.frequency*t,period);
+        return phase < 0.0 ? phase + period : phase;
+    }
+
+    // Angle between section j and the one behind it, the last section has no joint behind it
+    float getJointAngle(double phase, quint32 j) const
+    {
+        if(j+1 >= gait.sections)
+        {
+            return 0.0f;
+        }
+        return float(gait.amplitude*std::sin(phase + j*gait.phaseOffset)) + gait.turn;
+    }
+
+    // Centres of mass of all sections in meters relative to the head, which moves forward at the
+    // gait speed. The head is turned so the mean direction of the body is the direction of travel.
+    void shape(double phase, std::vector<segmentPose> & poses, segmentPose & head)
+    {
+        joints.resize(gait.sections);
+        float cumulative = 0.0f;
+        float mean = 0.0f;
+        for(quint32 j = 0; j < gait.sections; ++j)
+        {
+            mean += cumulative;
+            joints[j].phi = getJointAngle(phase,j);
+            cumulative += joints[j].phi;
+        }
+        mean /= float(gait.sections);
+        head.x = 0.0f;
+        head.y = 0.0f;
+        head.rot = -mean;
+        computeSegmentPoses<1>(head.x,head.y,head.rot,joints,poses);
+    }
+
+    static void put(uchar *& p, float v)
+    {
+        quint32 bits;
+        std::memcpy(&bits,&v,4);
+        qToLittleEndian(bits,p);
+        p += 4;
+    }
+
+    serpenoidGait gait;
+    std::vector<snakeSectionData> joints;
+    std::vector<segmentPose> now;
+    std::vector<segmentPose> ahead;
+    std::vector<segmentPose> behind;
+    segmentPose nowHead;
+    segmentPose aheadHead;
+    segmentPose behindHead;
+};
+
+#endif // SERPENOID_H